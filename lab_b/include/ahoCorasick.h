@@ -0,0 +1,103 @@
+#ifndef AHO_CORASICK_H
+#define AHO_CORASICK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "virus.h"
+#include "sigArena.h"
+#include "prefilter.h"
+#include "hitBuffer.h"
+#include "matchEngine.h"
+
+#define AC_ALPHABET 256
+#define AC_ROOT 0
+#define AC_NONE -1
+// the auto layout keeps a full table of up to this many states, 1 KB each,
+// a fraction of the L2 cache: a larger one is slower than a sparse one
+#define AC_FULL_MAX_STATES 256
+
+// how the transitions of an automaton are stored
+typedef enum acLayout
+{
+    AC_LAYOUT_FULL,   // a row of AC_ALPHABET transitions per state
+    AC_LAYOUT_SPARSE, // the trie's children per state, and failure links
+    AC_LAYOUT_AUTO    // full while the table fits in the caches
+} acLayout;
+
+// a state of a sparse automaton. its children in the trie are numbered in
+// the order of their bytes, so a bitmap of the bytes and the rank of a byte
+// in it find the child. a byte without a child is followed from the failure
+// state, down to the root whose row is full
+typedef struct acNode
+{
+    uint64_t children[AC_ALPHABET / 64]; // the bytes with a child
+    int32_t firstChild;
+    int32_t fail;
+    uint8_t rank[AC_ALPHABET / 64];      // children in the previous words
+} acNode;
+
+// a deterministic Aho-Corasick automaton over the viruses of an arena, the
+// matcher of the arena. states are numbered in breadth first order, so the
+// shallow states most bytes stay in are close together. with another
+// engine, only the tables of that engine are built and the automaton has
+// no states
+typedef struct acAutomaton
+{
+    unsigned int stateCount;
+    unsigned int patternCount;
+    unsigned short maxLength;
+    acLayout layout;
+    const sigArena *arena; // the viruses, hits refer to their list order
+    int *delta;        // rows of AC_ALPHABET transitions, the root's alone
+                       // in a sparse automaton
+    acNode *nodes;     // per state, of a sparse automaton
+    int *firstOutput;  // per state, a virus ending at the state or AC_NONE
+    int *nextOutput;   // per virus, another virus with the same signature
+    int *dictLink;     // per state, the longest suffix state with an output
+    acPrefilter *prefilter; // skips offsets while in the root state
+    matchEngine engine;     // the algorithm acScan runs
+    shiftTables *shift;     // of the shift engine
+} acAutomaton;
+
+/* Builds an automaton matching the signatures of a sealed arena, which */
+/* must outlive it. Signatures of size 0 are ignored, and patterns are */
+/* matched by their anchors and checked where one is found. The selected */
+/* engine is used, or the one engineChoose picks for the arena */
+acAutomaton *acBuild(const sigArena *arena);
+
+/* Builds a matcher of the arena that scans with the given engine */
+acAutomaton *acBuildEngine(const sigArena *arena, matchEngine engine);
+
+/* Builds an automaton of the arena with the given layout, whatever the */
+/* selected engine */
+acAutomaton *acBuildLayout(const sigArena *arena, acLayout layout);
+
+/* Selects the layout of the automata built from now on, AC_LAYOUT_AUTO */
+/* picks one by the number of states. Returns false if unknown */
+bool acLayoutSelect(acLayout layout);
+
+/* Returns the selected layout */
+acLayout acLayoutCurrent();
+
+/* Returns the name of a layout */
+const char *acLayoutName(acLayout layout);
+
+/* Returns the bytes of memory the matcher's tables take, the arena aside */
+size_t acMemory(const acAutomaton *automaton);
+
+/* Releases all the memory held by the automaton */
+void acFree(acAutomaton *automaton);
+
+/* Returns the virus of a hit */
+#define acVirus(AUTOMATON, INDEX) arenaVirus((AUTOMATON)->arena, INDEX)
+
+/* Scans the buffer with the matcher's engine and appends the hits to */
+/* hits, their offsets relative to the buffer, sorted by offset and then */
+/* by list order. The bytes, the time and the checks of every virus are */
+/* counted in the thread's statsThread counters, if there are any */
+/* Returns the number of hits appended */
+size_t acScan(const acAutomaton *automaton, const unsigned char *buffer,
+              size_t size, hitBuffer *hits);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef DIR_SCAN_H
+#define DIR_SCAN_H
+
+#include <stdbool.h>
+#include "ahoCorasick.h"
+#include "streamScan.h"
+#include "scanCache.h"
+#include "hashSet.h"
+
+// files bigger than this are split into segments scanned in parallel
+#define SEGMENT_SIZE (64LL << 20)
+
+// called before the hits of an infected file, or for a file that failed
+typedef void (*fileHandler)(void *context, const char *path, bool failed);
+
+// called after onFile for a file whose digest is on the blocklist
+typedef void (*digestHandler)(void *context,
+                              const unsigned char digest[SHA256_SIZE]);
+
+typedef struct treeSummary
+{
+    unsigned long long files;
+    unsigned long long infected;
+    unsigned long long failed;
+    unsigned long long unchanged; // clean files skipped thanks to the cache
+    unsigned long long sameInode;   // hard links to a file seen before
+    unsigned long long sameContent; // copies of a file seen before
+    unsigned long long hashed;      // files hashed to find their copies,
+                                    // once each
+    unsigned long long knownBad;    // files whose digest is on the blocklist
+} treeSummary;
+
+/* Scans every regular file under root on threadCount threads */
+/* Results are reported from the calling thread in the order of the walk */
+/* (sorted by name), onFile for the file and then onHit for each hit */
+/* With a cache, files known to be clean are skipped and the verdicts of */
+/* the files seen, skipped or scanned, are recorded in it. Infected files */
+/* are always scanned so their hits can be reported. With dedup, a file */
+/* with the inode of a file seen before, or the content of one, found by */
+/* its size and hash and then compared byte by byte, isn't scanned and is */
+/* reported with that file's verdict and hits. With a blocklist, the */
+/* SHA-256 of every file is looked up before it is scanned, and a listed */
+/* file is reported with onFile and onDigest instead */
+/* Returns false if the pool couldn't start */
+bool scanTree(const char *root, const acAutomaton *matcher, int threadCount,
+              scanCache *cache, bool dedup, const hashSet *blocklist,
+              fileHandler onFile, hitHandler onHit, digestHandler onDigest,
+              void *context, treeSummary *summary);
+
+/* Returns the number of online processors */
+int defaultThreadCount();
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef DIR_WATCH_H
+#define DIR_WATCH_H
+
+#include <stdbool.h>
+#include "ahoCorasick.h"
+#include "streamScan.h"
+#include "dirScan.h"
+
+#define WATCH_MAX_DIRECTORIES 64
+#define WATCH_SETTLE_MS 100    // how long a file must go without events
+#define WATCH_PENDING_MAX 4096 // files waiting to settle, or for the queue
+#define WATCH_QUEUE_MAX 256    // files queued on the workers or being scanned
+
+typedef struct watchSummary
+{
+    unsigned long long events;    // about files written or moved in
+    unsigned long long merged;    // events for a file that was already waiting
+    unsigned long long files;     // scanned
+    unsigned long long infected;
+    unsigned long long failed;
+    unsigned long long vanished;  // gone before they were scanned
+    unsigned long long stalled;   // files that settled while the queue was full
+    unsigned long long dropped;   // files never scanned, too many were waiting
+    unsigned long long overflows; // times the kernel's event queue overflowed
+    unsigned int queuePeak;       // the most files queued at once
+} watchSummary;
+
+// called from the watching thread with a snapshot of the counters
+typedef void (*watchStatusHandler)(void *context, const watchSummary *summary);
+
+/* Scans the regular files written to, or moved into, the given directories */
+/* (not their subdirectories) on threadCount threads, until SIGINT or */
+/* SIGTERM. Events for a file are merged until it settles for */
+/* WATCH_SETTLE_MS, and at most WATCH_QUEUE_MAX files are queued, the rest */
+/* wait and are dropped past WATCH_PENDING_MAX. Results are reported from */
+/* the workers, one file at a time, onFile for the file and then onHit for */
+/* each hit. SIGUSR1 reports the counters to onStatus */
+/* Returns false if a directory can't be watched or the pool couldn't start */
+bool watchDirectories(char *const *directories, int count,
+                      const acAutomaton *matcher, int threadCount,
+                      fileHandler onFile, hitHandler onHit,
+                      watchStatusHandler onStatus, void *context,
+                      watchSummary *summary);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef ELF_SCAN_H
+#define ELF_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ELF_NAME_MAX 32
+
+// a part of an ELF file holding code
+typedef struct elfRegion
+{
+    char name[ELF_NAME_MAX]; // the section's name, or segment<N>
+    uint64_t offset;         // in the file
+    uint64_t size;
+} elfRegion;
+
+/* Finds the executable sections of an ELF image of either class in the */
+/* native byte order, or its executable loadable segments if it has no */
+/* section headers. Returns the number of regions, allocated in regions */
+/* which the caller frees, or -1 if the image isn't such an ELF file */
+int elfRegions(const unsigned char *image, size_t size, elfRegion **regions);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef HASH_SET_H
+#define HASH_SET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sha256.h"
+#include "mappedFile.h"
+
+#define HASH_MAGIC "VHSH"
+#define HASH_VERSION 1
+#define HASH_BUCKET_LOAD 4 // digests per bucket of the index, at least
+
+// the header of a compiled blocklist, followed by its digests sorted and
+// without duplicates
+typedef struct hashHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+} hashHeader;
+
+// called for a line of a text blocklist that isn't a digest, numbered from 1
+typedef void (*badLineHandler)(void *context, const char *path,
+                               unsigned long line);
+
+// a set of SHA-256 digests of known bad files. the digests are sorted, and
+// an index of where every range of their first bits starts finds the few
+// a digest may be among, in constant time
+typedef struct hashSet
+{
+    const unsigned char *digests; // count digests of SHA256_SIZE bytes
+    size_t count;
+    uint32_t *buckets;            // 2^bucketBits + 1 starts into digests
+    unsigned int bucketBits;
+    mappedFile file;              // of a compiled blocklist
+    unsigned char *owned;         // the digests of a text blocklist
+    size_t skipped;               // its lines that weren't digests
+} hashSet;
+
+/* Loads a compiled blocklist by mapping it, or a text one with a digest */
+/* in hex at the start of every line (as sha256sum prints them). Blank */
+/* lines and lines starting with # are skipped, and so is a line that */
+/* isn't a digest, which is counted and given to onBadLine unless it is */
+/* NULL. Returns false if the file can't be read */
+bool hashSetLoad(hashSet *set, const char *path, badLineHandler onBadLine,
+                 void *context);
+
+/* Returns true if the digest is in the set */
+bool hashSetContains(const hashSet *set,
+                     const unsigned char digest[SHA256_SIZE]);
+
+/* Writes the set as a compiled blocklist */
+bool hashSetCompile(const hashSet *set, const char *path);
+
+/* Returns a digest of the set, the same for a text file and its compiled */
+/* blocklist */
+uint64_t hashSetDigest(const hashSet *set);
+
+/* Returns the bytes of memory the set uses */
+size_t hashSetMemory(const hashSet *set);
+
+/* Releases the set, and empties it */
+void hashSetFree(hashSet *set);
+
+#endif
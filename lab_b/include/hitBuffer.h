@@ -0,0 +1,36 @@
+#ifndef HIT_BUFFER_H
+#define HIT_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// a single match: the first byte of the signature and the matched virus
+typedef struct scanHit
+{
+    unsigned long long offset;
+    unsigned int virusIndex; // in list order
+} scanHit;
+
+// a growing array of hits. clearing it keeps its memory, so a buffer reused
+// for every window or file stops allocating once it is big enough
+typedef struct hitBuffer
+{
+    scanHit *hits;
+    size_t count;
+    size_t capacity;
+} hitBuffer;
+
+/* Appends a hit, returns false if the buffer couldn't grow */
+bool hitAppend(hitBuffer *buffer, unsigned int virusIndex,
+               unsigned long long offset);
+
+/* Sorts the hits from index first on by offset and then by list order */
+void hitSort(hitBuffer *buffer, size_t first);
+
+/* Empties the buffer and keeps its memory */
+void hitClear(hitBuffer *buffer);
+
+/* Releases the memory of the buffer and empties it */
+void hitFree(hitBuffer *buffer);
+
+#endif
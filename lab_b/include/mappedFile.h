@@ -0,0 +1,26 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// a whole file mapped into memory
+typedef struct mappedFile
+{
+    unsigned char *data; // NULL for an empty file
+    size_t size;
+    bool writable;       // changes to data are written to the file
+} mappedFile;
+
+/* Maps the whole file, read-only or shared and writable */
+/* Returns false if the file can't be opened, doesn't fit in memory, or */
+/* isn't a regular file and has no size, so it has to be read instead */
+bool mapFile(mappedFile *file, const char *path, bool writable);
+
+/* Flushes changes of a writable mapping to the disk */
+bool syncFile(mappedFile *file);
+
+/* Unmaps the file */
+void unmapFile(mappedFile *file);
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef MATCH_ENGINE_H
+#define MATCH_ENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sigArena.h"
+#include "hitBuffer.h"
+#include "scanStats.h"
+
+// the shift engine is picked for keys at least this long: shorter windows
+// jump too little to beat one transition per byte
+#define SHIFT_MIN_KEY 3
+
+#define SHIFT_TABLE_SIZE (1 << 16)
+
+// and for fewer keys than this: with more, the last blocks of their windows
+// cover most of the table, the shift is 0 almost everywhere and the engine
+// checks candidates at nearly every offset, slower than the automaton
+#define SHIFT_MAX_KEYS (SHIFT_TABLE_SIZE * 3 / 4)
+
+// the algorithms a matcher can scan with. the automaton is 0, the engine
+// of a zeroed matcher
+typedef enum matchEngine
+{
+    ENGINE_AUTOMATON, // Aho-Corasick, one transition per byte
+    ENGINE_SHIFT,     // Wu-Manber, skips windows by their last 2 bytes
+    ENGINE_NAIVE,     // every key compared at every offset, a reference
+    ENGINE_AUTO       // picked from the keys' statistics
+} matchEngine;
+
+// what the choice of an engine depends on, of the keys of an arena: the
+// bytes each engine looks for, the anchor of a pattern and the signature of
+// any other virus
+typedef struct keyStats
+{
+    unsigned int keys;          // viruses with a key
+    unsigned short shortest;    // key lengths
+    unsigned short longest;
+    unsigned short maxLength;   // the longest match of any virus
+    unsigned int firstBytes;    // distinct first bytes
+    unsigned long long keyBytes;
+} keyStats;
+
+// the tables of the shift engine. a window of the shortest key's length
+// ends at every scanned offset, and the block of its last blockBytes bytes
+// tells how far the next window that may end a key is
+typedef struct shiftTables
+{
+    unsigned short windowLength;
+    unsigned short blockBytes;  // 2, or 1 for keys of a single byte
+    uint16_t *shift;            // per block, 0 if a key's window ends in it
+    uint32_t *bucketStart;      // per block + 1, ranges in candidates
+    uint32_t *candidates;       // viruses, by the last block of their window
+} shiftTables;
+
+/* Computes the statistics of the keys of a sealed arena */
+void keyStatsCollect(keyStats *stats, const sigArena *arena);
+
+/* Returns the engine that scans the keys the fastest */
+matchEngine engineChoose(const keyStats *stats);
+
+/* Selects the engine of the matchers built from now on, ENGINE_AUTO picks */
+/* one for every arena from its statistics. Returns false if unknown */
+bool engineSelect(matchEngine engine);
+
+/* Returns the selected engine */
+matchEngine engineCurrent();
+
+/* Returns the name of an engine */
+const char *engineName(matchEngine engine);
+
+/* Builds the shift tables of a sealed arena, which must outlive them */
+shiftTables *shiftBuild(const sigArena *arena, const keyStats *stats);
+
+/* Releases the tables */
+void shiftFree(shiftTables *tables);
+
+/* Returns the bytes the tables take */
+size_t shiftMemory(const shiftTables *tables);
+
+/* Scans the buffer with the shift tables and appends the hits to hits, */
+/* sorted as acScan sorts them, counting the checks of every virus in */
+/* stats unless it is NULL. Returns the number of hits appended */
+size_t shiftScan(const shiftTables *tables, const sigArena *arena,
+                 const unsigned char *buffer, size_t size, hitBuffer *hits,
+                 scanStats *stats);
+
+/* Checks the candidates of patterns the scan of the buffer left */
+/* undecided, releases them and sorts the hits appended from first on. */
+/* Returns the number of hits appended, or 0 after dropping them if the */
+/* memory couldn't be allocated */
+size_t engineFinish(const sigArena *arena, const unsigned char *buffer,
+                    size_t size, hitBuffer *undecided, hitBuffer *hits,
+                    size_t first);
+
+/* Scans the buffer comparing the keys that start with each byte, and */
+/* appends the hits and counts the checks as shiftScan does. Returns the */
+/* number of hits appended */
+size_t naiveScan(const sigArena *arena, const unsigned char *buffer,
+                 size_t size, hitBuffer *hits, scanStats *stats);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sigArena.h"
+
+// up to this many distinct first bytes are compared directly
+#define PREFILTER_MAX_BYTES 8
+// with more distinct first bytes than this, hardly any offset is skipped
+#define PREFILTER_DENSE 96
+
+typedef enum prefilterLevel
+{
+    PREFILTER_OFF,
+    PREFILTER_SCALAR,
+    PREFILTER_SSE2,
+    PREFILTER_AVX2,
+    PREFILTER_BEST
+} prefilterLevel;
+
+// tables of the first two bytes of every signature. plain data, so a
+// compiled database can store it as is.
+typedef struct acPrefilter
+{
+    uint8_t pairs[ARENA_ALPHABET * ARENA_ALPHABET / 8]; // first two bytes
+    uint8_t single[ARENA_ALPHABET / 8]; // signatures of a single byte
+    uint8_t first[ARENA_ALPHABET / 8];  // first bytes
+    uint8_t lowNibble[16];              // first bytes, by bucket
+    uint8_t highNibble[16];
+    uint8_t distinct[PREFILTER_MAX_BYTES];
+    uint32_t distinctCount;
+    uint32_t enabled;                   // can the prefilter skip anything?
+} acPrefilter;
+
+/* Fills the tables from the index of a sealed arena */
+void prefilterBuild(acPrefilter *prefilter, const sigArena *arena);
+
+/* Selects the implementation, PREFILTER_BEST picks the fastest one the */
+/* processor supports. Returns false if level is not supported */
+bool prefilterSelect(prefilterLevel level);
+
+/* Returns the selected implementation */
+prefilterLevel prefilterCurrent();
+
+/* Returns the first offset in [from, size) where a signature may start, */
+/* or size if there is none */
+size_t prefilterFind(const acPrefilter *prefilter,
+                     const unsigned char *buffer, size_t from, size_t size);
+
+#endif
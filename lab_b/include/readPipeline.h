@@ -0,0 +1,32 @@
+#ifndef READ_PIPELINE_H
+#define READ_PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ahoCorasick.h"
+#include "streamScan.h"
+
+#define PIPELINE_DEPTH 4
+#define PIPELINE_MAX_DEPTH 64
+#define PIPELINE_MAX_CHUNK (64 << 20)
+
+// how long each side of a pipeline waited for the other one
+typedef struct pipelineStats
+{
+    unsigned long long chunks;
+    unsigned long long bytes;
+    unsigned long long holeBytes;     // skipped without reading
+    unsigned long long readerStalls;  // times the ring was full
+    unsigned long long scannerStalls; // times the ring was empty
+    double readerSeconds;             // spent waiting for a free slot
+    double scannerSeconds;            // spent waiting for a filled slot
+} pipelineStats;
+
+/* Scans everything readable from fd like streamScanFd, while a reader */
+/* thread fills a ring of depth slots of chunkSize bytes ahead of the scan */
+/* Returns false on a read error or if the ring can't be allocated */
+bool pipelineScanFd(int fd, const acAutomaton *matcher, int depth,
+                    size_t chunkSize, hitHandler onHit, void *context,
+                    pipelineStats *stats);
+
+#endif
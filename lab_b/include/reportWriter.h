@@ -0,0 +1,66 @@
+#ifndef REPORT_WRITER_H
+#define REPORT_WRITER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sha256.h"
+
+// records are written out in blocks of about this size
+#define REPORT_BUFFER (256 << 10)
+
+typedef enum reportFormat
+{
+    REPORT_TEXT,  // the "# NAME (SIZE) @ 0xOFFSET" lines printed so far
+    REPORT_JSONL, // an object per line
+    REPORT_CSV    // a header line, then path,event,virus,size,offset,
+                  // region,detail
+} reportFormat;
+
+// the results of the scans, formatted into a buffer of its own and written
+// out a whole file at a time: the records of a file are written once the
+// next file starts and half the buffer is used, or when it is flushed
+typedef struct reportWriter
+{
+    FILE *out;
+    reportFormat format;
+    bool namingFiles; // text: a "*> PATH" line before every infected file
+    bool eager;       // write every record out at once
+    bool failed;      // a write failed
+    const char *path; // the file whose results are reported
+    char *buffer;
+    size_t used;
+} reportWriter;
+
+/* Prepares a writer of the format into out, writes the CSV header. */
+/* Returns false if the buffer couldn't be allocated */
+bool reportInit(reportWriter *writer, FILE *out, reportFormat format);
+
+/* Starts the results of the file at path, which must outlive them. A file */
+/* that couldn't be scanned is given the error, reported on stderr as text */
+void reportFile(reportWriter *writer, const char *path, const char *error);
+
+/* Reports a virus of the current file, at offset in region, or in the */
+/* whole file if region is NULL */
+void reportHit(reportWriter *writer, const char *name, unsigned int size,
+               unsigned long long offset, const char *region);
+
+/* Reports that the SHA-256 of the current file is on the blocklist */
+void reportDigest(reportWriter *writer,
+                  const unsigned char digest[SHA256_SIZE]);
+
+/* Writes every record out, returns false if a write failed */
+bool reportFlush(reportWriter *writer);
+
+/* Flushes and releases the buffer, returns false if a write failed */
+bool reportClose(reportWriter *writer);
+
+/* Returns the format called name, or -1 */
+int reportFormatFind(const char *name);
+
+/* Writes the bytes as pairs of lowercase hex digits into out, each one */
+/* followed by a space if spaced. Returns the number of characters */
+size_t reportHex(char *out, const unsigned char *data, size_t length,
+                 bool spaced);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SCAN_BENCH_H
+#define SCAN_BENCH_H
+
+#include <stdbool.h>
+#include "ahoCorasick.h"
+
+#define BENCH_RUNS 3
+
+/* Repeats the sample file up to megabytes and scans it once per prefilter */
+/* implementation the processor supports, printing a key=value line with */
+/* the best throughput of each. Returns false if the sample can't be read */
+bool benchPrefilter(const acAutomaton *matcher, const char *sample,
+                    unsigned int megabytes);
+
+/* Repeats the sample file up to megabytes and scans it with a matcher of */
+/* the arena built with every engine, printing a key=value line with the */
+/* build time and the best throughput of each, and the engine ENGINE_AUTO */
+/* picks. Returns false if the sample can't be read */
+bool benchEngines(const sigArena *arena, const char *sample,
+                  unsigned int megabytes);
+
+/* Repeats the sample file up to megabytes and scans it with an automaton */
+/* of the arena built in every layout, printing a key=value line with the */
+/* memory of each, per signature too, its build time and best throughput, */
+/* and the layout AC_LAYOUT_AUTO picks. Returns false if the sample can't */
+/* be read */
+bool benchLayouts(const sigArena *arena, const char *sample,
+                  unsigned int megabytes);
+
+/* Scans a file the way the menu does and prints a key=value line with the */
+/* throughput and the peak resident memory of the process so far. With a */
+/* depth, the file is read by a pipeline of depth slots of chunkSize bytes */
+/* and the stalls of both sides are printed too. Returns false if the file */
+/* can't be read */
+bool benchScanFile(const acAutomaton *matcher, const char *path, int depth,
+                   size_t chunkSize);
+
+/* Returns a monotonic time in seconds */
+double benchClock();
+
+/* Returns the peak resident memory of the process in kilobytes */
+long benchPeakRss();
+
+#endif
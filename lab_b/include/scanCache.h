@@ -0,0 +1,83 @@
+#ifndef SCAN_CACHE_H
+#define SCAN_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "VSCC"
+#define CACHE_VERSION 2
+#define CACHE_BYTE_ORDER 0x01020304
+
+typedef enum cacheVerdict
+{
+    VERDICT_CLEAN,
+    VERDICT_INFECTED
+} cacheVerdict;
+
+// the header of a scan cache file, followed by its entries sorted by
+// device and inode, all in the native byte order
+typedef struct cacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;    // CACHE_BYTE_ORDER as written by the sweep
+    uint32_t entrySize;
+    uint64_t sigVersion;   // the digest of the signatures the files were
+                           // scanned with
+    uint64_t count;
+} cacheHeader;
+
+// the verdict of a file as it was when it was scanned
+typedef struct cacheEntry
+{
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtimeSeconds;
+    int64_t ctimeSeconds;      // the status change time, which can't be set
+    uint32_t mtimeNanoseconds;
+    uint32_t ctimeNanoseconds;
+    uint32_t verdict;
+    uint32_t reserved;         // the same size on 32 and 64-bit builds
+} cacheEntry;
+
+typedef struct scanCache
+{
+    char *path;
+    void *base;                // the mapped cache file, NULL if there is none
+    size_t size;
+    const cacheEntry *entries; // in the mapping
+    size_t count;
+    uint64_t sigVersion;
+    bool rescan;               // ignore the verdicts, but still record them
+    cacheEntry *updates;       // files seen by this sweep, unsorted
+    size_t updateCount, updateCapacity;
+} scanCache;
+
+/* Maps the cache file at path. A missing or invalid file, or one written */
+/* with other signatures, is treated as an empty cache. Returns false if */
+/* the cache can't be allocated */
+bool cacheOpen(scanCache *cache, const char *path, uint64_t sigVersion,
+               bool rescan);
+
+/* Returns true and sets verdict if the file described by info is unchanged */
+/* since it was scanned */
+bool cacheLookup(const scanCache *cache, const struct stat *info,
+                 cacheVerdict *verdict);
+
+/* Records the verdict of a file seen by this sweep, scanned or found */
+/* unchanged. Only the files recorded are kept when the cache is saved */
+void cacheRecord(scanCache *cache, const struct stat *info,
+                 cacheVerdict verdict);
+
+/* Replaces the cache file with the entries of the files this sweep saw, */
+/* dropping the files that are gone. Returns false on failure, leaving the */
+/* old file as it was */
+bool cacheSave(scanCache *cache);
+
+/* Unmaps the cache and releases it */
+void cacheClose(scanCache *cache);
+
+#endif
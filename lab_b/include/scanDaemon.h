@@ -0,0 +1,56 @@
+#ifndef SCAN_DAEMON_H
+#define SCAN_DAEMON_H
+
+#include <stdbool.h>
+#include <linux/limits.h> // for PATH_MAX
+#include "sigGeneration.h"
+
+// the requests of a client, one per line
+#define REQUEST_SCAN "SCAN " // followed by the path of a file to scan
+#define REQUEST_FD "FD"      // sent with a descriptor of the file to scan
+
+// the daemon answers every request with a line per virus found,
+//     hit name=NAME size=SIZE offset=0xOFFSET
+// and then a single verdict line,
+//     verdict=clean hits=0
+//     verdict=infected hits=COUNT
+//     verdict=error error=MESSAGE
+#define RESPONSE_HIT "hit "
+#define RESPONSE_VERDICT "verdict="
+
+#define DAEMON_LINE_MAX (PATH_MAX + 16)
+#define DAEMON_MAX_FDS 8 // descriptors a client may send ahead of requests
+#define DAEMON_BACKLOG 64
+#define DAEMON_MAX_CLIENTS 256  // connected at once, the others wait
+#define DAEMON_IDLE_SECONDS 60  // a client waited for longer is disconnected
+
+// what a daemon did until it was stopped
+typedef struct daemonSummary
+{
+    unsigned long long connections;
+    unsigned long long requests;
+    unsigned long long infected;
+    unsigned long long failed;
+    unsigned long long reloads;       // of the signatures, on SIGHUP
+    unsigned long long failedReloads;
+} daemonSummary;
+
+// loads the signatures anew, returns NULL if they couldn't be loaded
+typedef sigGeneration *(*generationLoader)(void);
+
+/* Listens on a UNIX stream socket at path, replacing a stale socket, that */
+/* only the calling user can connect to, and serves the clients until */
+/* SIGINT or SIGTERM: the calling thread waits for their requests, and */
+/* threadCount threads scan, a request at a time. A client that sends */
+/* nothing for DAEMON_IDLE_SECONDS is disconnected, and at most */
+/* DAEMON_MAX_CLIENTS are connected at once. The socket is removed when it */
+/* stops */
+/* Scans use first until SIGHUP, which loads a generation with load in the */
+/* background and publishes it for the scans that start afterwards */
+/* The daemon owns first. Returns false if the socket or the threads */
+/* couldn't be set up */
+bool daemonServe(const char *path, sigGeneration *first,
+                 generationLoader load, int threadCount,
+                 daemonSummary *summary);
+
+#endif
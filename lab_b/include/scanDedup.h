@@ -0,0 +1,45 @@
+#ifndef SCAN_DEDUP_H
+#define SCAN_DEDUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define DEDUP_CHUNK (256 << 10) // read by the hash pass at a time
+
+typedef struct dedupSlot
+{
+    uint64_t first;  // device and inode, or size and content hash
+    uint64_t second;
+    void *value;     // NULL in an empty slot
+} dedupSlot;
+
+// an open-addressing table from a pair of numbers to a pointer
+typedef struct dedupTable
+{
+    dedupSlot *slots;
+    size_t count, capacity; // capacity is a power of 2
+    unsigned long long lookups, hits;
+} dedupTable;
+
+/* Returns the value of a key, or NULL, and counts the lookup */
+void *dedupFind(dedupTable *table, uint64_t first, uint64_t second);
+
+/* Adds a key that isn't in the table. Returns false if out of memory */
+bool dedupInsert(dedupTable *table, uint64_t first, uint64_t second,
+                 void *value);
+
+/* Releases the slots, the values are the caller's */
+void dedupFree(dedupTable *table);
+
+/* Hashes the first size bytes of a file, reading it with pread, into a */
+/* fast non-cryptographic 64-bit hash. Returns false if it can't be read */
+bool hashContent(int fd, off_t size, uint64_t *hash);
+
+/* Returns true if the first size bytes of two files are the same, read */
+/* with pread, so a hash match is known not to be a collision. Returns */
+/* false if they differ or can't be read */
+bool sameContent(int fd, int otherFd, off_t size);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SCAN_STATS_H
+#define SCAN_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// the counters of a thread, or their sum. a thread counts into its own, so
+// counting takes no lock, and they are merged when they are printed
+typedef struct scanStats
+{
+    unsigned int virusCount;
+    unsigned long long *hits;     // per virus, the hits reported
+    unsigned long long *attempts; // per virus, the offsets it was checked
+                                  // at: where the automaton found its key,
+                                  // or the other engines compared it
+    unsigned long long bytes;     // given to the engine, window overlaps
+                                  // included
+    double loadSeconds;
+    double scanSeconds;           // in the engine
+    double neutralizeSeconds;
+    struct scanStats *next;       // of another thread
+} scanStats;
+
+/* Starts counting for virusCount viruses, dropping the counters of every */
+/* thread. No other thread may be scanning */
+void statsReset(unsigned int virusCount);
+
+/* Stops counting and releases the counters of every thread */
+void statsStop();
+
+/* Returns the counters of the calling thread, or NULL if nothing is */
+/* counted */
+scanStats *statsThread();
+
+/* Returns the counters of every thread that counted, linked by next */
+const scanStats *statsList();
+
+/* Sums the counters of every thread into total, which statsFree releases. */
+/* Returns false if nothing is counted, or if total couldn't be allocated. */
+/* No other thread may be scanning */
+bool statsMerge(scanStats *total);
+
+/* Releases the counters of a sum */
+void statsFree(scanStats *total);
+
+/* Returns a monotonic time in seconds */
+double statsClock();
+
+/* Counts a check of a virus where its key was found, if stats isn't NULL */
+static inline void statsAttempt(scanStats *stats, unsigned int index)
+{
+    if (stats)
+    {
+        stats->attempts[index]++;
+    }
+}
+
+/* Counts a hit of a virus, if stats isn't NULL */
+static inline void statsHit(scanStats *stats, unsigned int index)
+{
+    if (stats)
+    {
+        stats->hits[index]++;
+    }
+}
+
+#endif
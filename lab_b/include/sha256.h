@@ -0,0 +1,32 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32
+#define SHA256_BLOCK 64
+
+typedef struct sha256Context
+{
+    uint32_t state[8];
+    uint64_t length;                    // of the message so far, in bytes
+    unsigned char block[SHA256_BLOCK];  // the partial block
+    size_t used;
+} sha256Context;
+
+/* Starts a digest */
+void sha256Init(sha256Context *context);
+
+/* Adds bytes to the message */
+void sha256Update(sha256Context *context, const void *data, size_t length);
+
+/* Pads the message and writes its digest */
+void sha256Final(sha256Context *context, unsigned char digest[SHA256_SIZE]);
+
+/* Digests a whole file, reading it from its start with pread */
+/* Returns false if it can't be read */
+bool sha256File(int fd, unsigned char digest[SHA256_SIZE]);
+
+#endif
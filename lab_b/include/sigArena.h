@@ -0,0 +1,49 @@
+#ifndef SIG_ARENA_H
+#define SIG_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "virus.h"
+
+#define ARENA_ALPHABET 256
+
+// all the viruses in a single block: the records one after the other, and
+// once the arena is sealed, the indexes after them
+typedef struct sigArena
+{
+    unsigned char *block;
+    size_t used;              // bytes of records
+    size_t capacity;
+    unsigned int count;
+    uint32_t *offsets;        // per virus in list order, its record's offset
+    uint32_t *byFirstByte;    // viruses with a signature, sorted by the first
+                              // byte of the signature and then by its size
+    uint32_t *bucketStart;    // ARENA_ALPHABET + 1 ranges in byFirstByte
+    bool mapped;              // the block belongs to a mapped database
+} sigArena;
+
+/* Returns the virus at index in list order */
+#define arenaVirus(ARENA, INDEX) \
+    ((virus *)((ARENA)->block + (ARENA)->offsets[INDEX]))
+
+/* Returns the bytes a record of a signature of size takes */
+#define arenaRecordSize(SIZE) \
+    ((sizeof(virus) + ((SIZE) & SIG_LENGTH) + 1) & ~(size_t)1)
+
+/* Makes room for a virus with a signature of size bytes at the end of */
+/* the records, returns NULL on failure. The virus is valid until the next */
+/* append */
+virus *arenaAppend(sigArena *arena, unsigned short size);
+
+/* Builds the indexes. The list order is the reverse of the append order, */
+/* the newest virus first. Returns false on failure */
+bool arenaSeal(sigArena *arena);
+
+/* Returns a digest of the records, which changes with any signature */
+uint64_t arenaDigest(const sigArena *arena);
+
+/* Releases the block of an arena that is not mapped, and empties it */
+void arenaFree(sigArena *arena);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SIG_DATABASE_H
+#define SIG_DATABASE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "virus.h"
+#include "sigArena.h"
+#include "ahoCorasick.h"
+
+#define DB_MAGIC "VIRC"
+#define DB_VERSION 5
+#define DB_BYTE_ORDER 0x01020304
+
+// the header of a compiled signatures database. every section is stored in
+// the native byte order, at an offset aligned to 8 bytes.
+typedef struct dbHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;     // DB_BYTE_ORDER as written by the compiler
+    uint32_t virusCount;
+    uint32_t stateCount;
+    uint32_t maxLength;
+    uint32_t layout;        // of the automaton
+    uint32_t nodeSize;      // sizeof(acNode) as built by the compiler
+    uint64_t arenaOffset;   // the sealed arena's block
+    uint64_t arenaSize;
+    uint64_t recordsSize;   // the arena's indexes, relative to its block
+    uint64_t offsetsOffset;
+    uint64_t byFirstByteOffset;
+    uint64_t bucketStartOffset;
+    uint64_t deltaOffset;   // the automaton's arrays
+    uint64_t nodesOffset;   // empty for a full automaton
+    uint64_t firstOutputOffset;
+    uint64_t nextOutputOffset;
+    uint64_t dictLinkOffset;
+    uint64_t prefilterOffset;
+    uint64_t fileSize;
+} dbHeader;
+
+// a compiled database mapped into memory
+typedef struct sigDatabase
+{
+    void *base;
+    size_t size;
+    sigArena arena;         // its block is in the mapping
+    acAutomaton automaton;  // its arrays are in the mapping
+} sigDatabase;
+
+/* Writes the automaton and the arena of its viruses as a database, in */
+/* the automaton's layout. The matcher must have been built with */
+/* ENGINE_AUTOMATON */
+bool dbCompile(const char *path, const acAutomaton *automaton);
+
+/* Maps a compiled database, returns NULL if it is missing or invalid. */
+/* Its matcher scans with the stored automaton, unless the shift or the */
+/* naive engine is selected */
+sigDatabase *dbOpen(const char *path);
+
+/* Unmaps the database, its viruses and automaton are no longer valid */
+void dbClose(sigDatabase *db);
+
+#endif
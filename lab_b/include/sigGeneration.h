@@ -0,0 +1,53 @@
+#ifndef SIG_GENERATION_H
+#define SIG_GENERATION_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include "ahoCorasick.h"
+#include "sigArena.h"
+#include "sigDatabase.h"
+
+// a loaded set of signatures, shared by the scans that started while it was
+// the current one
+typedef struct sigGeneration
+{
+    sigArena viruses;
+    acAutomaton *matcher;
+    sigDatabase *database;  // the viruses and the matcher are mapped from it
+    unsigned long long number;
+    atomic_int references;  // of the scans using it, and of the library
+} sigGeneration;
+
+// where the current generation is published
+typedef struct sigLibrary
+{
+    pthread_mutex_t lock;   // held only to take or swap the current one
+    sigGeneration *current;
+    unsigned long long generations;
+} sigLibrary;
+
+/* Wraps a loaded arena and its matcher, or a mapped database, as a */
+/* generation. The arena is moved into the generation, and the matcher is */
+/* pointed at it. Returns NULL if out of memory, in which case nothing is */
+/* taken */
+sigGeneration *generationCreate(sigArena *viruses, acAutomaton *matcher,
+                                sigDatabase *database);
+
+/* Drops a reference to a generation, freeing it after its last one */
+void generationRelease(sigGeneration *generation);
+
+/* Publishes the first generation of a library */
+void libraryInit(sigLibrary *library, sigGeneration *first);
+
+/* Returns the current generation with a reference the caller releases. The */
+/* generation stays valid until then, even if a newer one is published */
+sigGeneration *libraryAcquire(sigLibrary *library);
+
+/* Publishes a generation in place of the current one, which is freed as */
+/* soon as the scans using it finish */
+void libraryPublish(sigLibrary *library, sigGeneration *generation);
+
+/* Releases the current generation */
+void libraryFree(sigLibrary *library);
+
+#endif
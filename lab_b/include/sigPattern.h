@@ -0,0 +1,95 @@
+#ifndef SIG_PATTERN_H
+#define SIG_PATTERN_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "virus.h"
+#include "sigArena.h"
+#include "hitBuffer.h"
+
+// the longest text a pattern may match, and so its number of elements
+#define PATTERN_MAX_SPAN 1024
+#define PATTERN_MAX_GAP 255
+#define PATTERN_MAX_SIZE \
+    (sizeof(sigPattern) + PATTERN_MAX_SPAN * (sizeof(patternElement) + 1))
+
+// the offsets patternMatch tries per element of a pattern before it leaves
+// the check to patternResolve
+#define PATTERN_STEPS 2
+
+// patternResolve checks together the candidates of a pattern that start
+// within this many bytes
+#define PATTERN_BATCH (64 << 10)
+
+typedef enum patternResult
+{
+    PATTERN_MISMATCH,
+    PATTERN_MATCH,
+    PATTERN_UNDECIDED // too costly to check at a single offset
+} patternResult;
+
+// a single byte of a pattern, preceded by a gap of gapMin to gapMax bytes
+typedef struct patternElement
+{
+    unsigned char value;
+    unsigned char mask;   // the bits of the byte that must equal value
+    unsigned char gapMin;
+    unsigned char gapMax;
+} patternElement;
+
+// a compiled pattern, the signature of a virus whose size has SIG_PATTERN.
+// the anchor is the longest run of exact bytes before the first gap of
+// variable size, so it is always at the same offset from the first byte.
+// its bytes follow the elements, and only they are put in the automaton
+typedef struct sigPattern
+{
+    unsigned short elementCount;
+    unsigned short anchorOffset;  // from the first byte of a match
+    unsigned short anchorLength;
+    unsigned short minSpan;       // the shortest and longest text matched
+    unsigned short maxSpan;
+    patternElement elements[];
+} sigPattern;
+
+/* Returns the compiled pattern of a virus whose size has SIG_PATTERN */
+#define virusPattern(VIR) ((const sigPattern *)(VIR)->sig)
+
+/* Returns the anchor of a compiled pattern */
+#define patternAnchor(PATTERN) \
+    ((const unsigned char *)((PATTERN)->elements + (PATTERN)->elementCount))
+
+/* Compiles the text of a pattern: pairs of hex digits, where a ? digit */
+/* matches any nibble, and gaps of {N}, {N-M} or {-M} bytes between them. */
+/* Blanks are ignored. Returns the size of the compiled pattern written to */
+/* compiled, which holds PATTERN_MAX_SIZE bytes, or 0 if the text is invalid */
+size_t patternCompile(const char *text, size_t length,
+                      unsigned char *compiled);
+
+/* Checks if the pattern matches the text starting at the buffer, trying */
+/* PATTERN_STEPS offsets per element at most. A pattern that needs more */
+/* is undecided: its gaps reach that many bytes, and checking it at every */
+/* offset of a text crafted to match its elements would be quadratic */
+patternResult patternMatch(const sigPattern *pattern,
+                           const unsigned char *buffer, size_t size);
+
+/* Checks the candidates, hits of patterns of the arena whose patternMatch */
+/* was undecided, in the buffer they were found in, and appends those that */
+/* match to hits. The candidates of a pattern are checked together, so a */
+/* byte is looked at once per element whatever their number. Sorts the */
+/* candidates. Returns false if the memory couldn't be allocated */
+bool patternResolve(const sigArena *arena, const unsigned char *buffer,
+                    size_t size, hitBuffer *candidates, hitBuffer *hits);
+
+/* Prints the text of a compiled pattern */
+void patternPrint(FILE *file, const sigPattern *pattern);
+
+/* Returns the bytes the automaton matches for a virus, their number in */
+/* length and their offset from the first byte of the virus in offset */
+const unsigned char *virusKey(const virus *vir, unsigned short *length,
+                              unsigned short *offset);
+
+/* Returns the size of the virus' signature, the shortest one of a pattern */
+unsigned short virusLength(const virus *vir);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef STREAM_SCAN_H
+#define STREAM_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "virus.h"
+#include "ahoCorasick.h"
+
+#define STREAM_CHUNK (64 << 10)
+
+// called for every virus found, offset is relative to the stream's start
+// and the virus is given by its index in the matcher's list order
+typedef void (*hitHandler)(void *context, unsigned int virusIndex,
+                           unsigned long long offset);
+
+// a fixed-size window sliding over a stream of any length. the last
+// (maxLength - 1) bytes of every window are kept as the start of the next
+// one, so signatures crossing a chunk boundary are still found.
+typedef struct scanStream
+{
+    const acAutomaton *matcher;
+    unsigned char *window;
+    size_t chunkSize;         // new bytes per window
+    size_t overlap;           // bytes carried over to the next window
+    size_t filled;            // bytes currently in the window
+    unsigned long long base;  // stream offset of window[0]
+    unsigned long long end;   // hits starting here or later aren't reported
+    hitHandler onHit;
+    void *context;
+    hitBuffer hits;           // the hits of the current window
+} scanStream;
+
+/* Allocates the window, returns false on failure */
+bool streamInit(scanStream *stream, const acAutomaton *matcher,
+                size_t chunkSize, hitHandler onHit, void *context);
+
+/* Returns the free part of the window and its size in *available */
+unsigned char *streamSpace(scanStream *stream, size_t *available);
+
+/* Marks count bytes of the free part as filled, scans a full window */
+void streamCommit(scanStream *stream, size_t count);
+
+/* Copies size bytes into the stream */
+void streamFeed(scanStream *stream, const unsigned char *data, size_t size);
+
+/* Advances the stream over length zero bytes, a hole of a sparse file. */
+/* Only the zeros next to the data around the hole are scanned, so a */
+/* signature of zeros alone is missed inside a long hole */
+void streamSkip(scanStream *stream, unsigned long long length);
+
+/* Finds the first data extent [*data, *hole) of a regular file at or */
+/* after position and before end, which is empty if only a hole is left. */
+/* Without hole support, sparse is cleared and the rest is one extent */
+void streamExtent(int fd, off_t position, off_t end, bool *sparse,
+                  off_t *data, off_t *hole);
+
+/* Scans whatever is left in the window, reports every remaining hit */
+void streamFinish(scanStream *stream);
+
+/* Releases the window and the hits */
+void streamFree(scanStream *stream);
+
+/* Scans everything readable from fd, returns false on a read error. The */
+/* holes of a regular file are skipped where the file system reports them */
+bool streamScanFd(int fd, const acAutomaton *matcher, hitHandler onHit,
+                  void *context);
+
+/* Scans fd as a stream until its end, however it is read, and copies */
+/* every byte read to copy unless it is -1, before scanning it. Returns */
+/* false on a read or a write error */
+bool streamScanPipe(int fd, int copy, const acAutomaton *matcher,
+                    hitHandler onHit, void *context);
+
+/* Reports the hits starting in [start, end) of a seekable file, reading */
+/* up to (maxLength - 1) bytes past end and skipping its holes, returns */
+/* false on a read error */
+bool streamScanRange(int fd, off_t start, off_t end,
+                     const acAutomaton *matcher, hitHandler onHit,
+                     void *context);
+
+#endif
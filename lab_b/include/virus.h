@@ -0,0 +1,22 @@
+#ifndef VIRUS_H
+#define VIRUS_H
+
+/* MACROS */
+
+// a size with this bit set is the size of a pattern instead of a byte string
+#define SIG_PATTERN 0x8000
+#define SIG_LENGTH 0x7fff
+
+/* STRUCTURES */
+
+// a virus is stored as in the signatures file: the size and the name,
+// immediately followed by the signature. in a signatures file, a pattern is
+// written as text, and it is compiled when it is loaded (see sigPattern.h)
+typedef struct virus
+{
+    unsigned short SigSize;
+    char virusName[16];
+    unsigned char sig[];
+} virus;
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define POOL_ANY_WORKER -1
+
+// a task gets its argument and the index of the worker running it
+typedef void (*taskFunction)(void *argument, int worker);
+
+typedef struct workTask
+{
+    taskFunction run;
+    void *argument;
+} workTask;
+
+// a worker's own tasks. the owner pushes and pops at the tail, thieves take
+// the oldest task from the head.
+typedef struct workDeque
+{
+    struct workPool *pool;
+    pthread_mutex_t lock;
+    workTask *tasks; // a ring of capacity tasks
+    size_t head, count, capacity;
+} workDeque;
+
+typedef struct workPool
+{
+    int workerCount;
+    int running;              // threads started so far
+    workDeque *deques;
+    pthread_t *threads;
+    pthread_mutex_t lock;     // guards pending, closing and nextDeque
+    pthread_cond_t available; // signaled when a task is submitted
+    size_t pending;           // tasks waiting in any deque
+    bool closing;
+    int nextDeque;            // round-robin target for outside submissions
+} workPool;
+
+/* Starts a pool of workerCount threads, returns NULL on failure */
+workPool *poolCreate(int workerCount);
+
+/* Queues a task on the deque of worker, or round-robin for POOL_ANY_WORKER */
+bool poolSubmit(workPool *pool, taskFunction run, void *argument, int worker);
+
+/* Waits for every queued task to finish, then stops and frees the pool */
+void poolDestroy(workPool *pool);
+
+#endif
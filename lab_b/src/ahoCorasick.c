@@ -0,0 +1,615 @@
+/**
+ * an Aho-Corasick automaton over the viruses' signatures.
+ *
+ * the trie of all the signatures is built first and its nodes are numbered
+ * in breadth first order. a full automaton turns it into a transition
+ * table, so scanning costs a single table lookup per byte of the buffer no
+ * matter how many signatures are loaded. the table takes 1 KB a state
+ * though, gigabytes for a database of a hundred thousand signatures, so a
+ * sparse automaton keeps the trie instead: a bitmap of the children of
+ * every state, and failure links followed for the other bytes. a state
+ * takes about 50 bytes then, and the shallow states a scan spends most of
+ * its time in stay in the caches.
+ *
+ * the automaton is one of the engines a matcher can scan with, the others
+ * are in matchEngine.c. acScan is where a scan is sent to the matcher's,
+ * and where its cost is counted.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../include/ahoCorasick.h"
+#include "../include/sigPattern.h"
+
+#define INITIAL_STATES 64
+
+// a node of the trie under construction
+typedef struct trieNode
+{
+    int firstChild; // the children, sorted by byte
+    int sibling;    // the next child of the parent
+    int output;     // a virus ending at the node
+    unsigned char byte;
+} trieNode;
+
+typedef struct trie
+{
+    trieNode *nodes;
+    unsigned int count;
+    unsigned int capacity;
+} trie;
+
+static const char *layoutNames[] = {"full", "sparse", "auto"};
+
+static acLayout selectedLayout = AC_LAYOUT_AUTO;
+
+/**
+ * @brief add a node with no children and no output to a trie.
+ *
+ * @param nodes the trie.
+ * @param byte the byte leading to the node.
+ * @return int the new node, or AC_NONE if the allocation failed.
+ */
+static int addNode(trie *nodes, unsigned char byte)
+{
+    trieNode *grown;
+
+    if (nodes->count == nodes->capacity)
+    {
+        if (!(grown = (trieNode *)realloc(nodes->nodes,
+                                          nodes->capacity * 2 *
+                                              sizeof(trieNode))))
+        {
+            return AC_NONE;
+        }
+
+        nodes->nodes = grown;
+        nodes->capacity *= 2;
+    }
+
+    nodes->nodes[nodes->count].firstChild = AC_NONE;
+    nodes->nodes[nodes->count].sibling = AC_NONE;
+    nodes->nodes[nodes->count].output = AC_NONE;
+    nodes->nodes[nodes->count].byte = byte;
+
+    return nodes->count++;
+}
+
+/**
+ * @brief insert a single signature into the trie, or the anchor of a
+ * pattern.
+ *
+ * @param nodes the trie.
+ * @param automaton the automaton under construction.
+ * @param index the index of the virus in the list.
+ * @return true if the signature was inserted.
+ */
+static bool insertPattern(trie *nodes, acAutomaton *automaton,
+                          unsigned int index)
+{
+    unsigned short length, offset;
+    const unsigned char *key = virusKey(acVirus(automaton, index), &length,
+                                        &offset);
+    int node = AC_ROOT, previous, child, added;
+
+    for (unsigned short i = 0; i < length; i++)
+    {
+        previous = AC_NONE;
+        child = nodes->nodes[node].firstChild;
+
+        while (child != AC_NONE && nodes->nodes[child].byte < key[i])
+        {
+            previous = child;
+            child = nodes->nodes[child].sibling;
+        }
+
+        if (child == AC_NONE || nodes->nodes[child].byte != key[i])
+        {
+            if ((added = addNode(nodes, key[i])) == AC_NONE)
+            {
+                return false;
+            }
+
+            nodes->nodes[added].sibling = child;
+
+            if (previous == AC_NONE)
+            {
+                nodes->nodes[node].firstChild = added;
+            }
+            else
+            {
+                nodes->nodes[previous].sibling = added;
+            }
+
+            child = added;
+        }
+
+        node = child;
+    }
+
+    automaton->nextOutput[index] = nodes->nodes[node].output;
+    nodes->nodes[node].output = index;
+
+    return true;
+}
+
+/**
+ * @brief number the nodes of the trie in breadth first order, as the states
+ * of a sparse automaton.
+ *
+ * @param nodes the complete trie.
+ * @param automaton the automaton under construction.
+ * @return true on success.
+ */
+static bool numberStates(const trie *nodes, acAutomaton *automaton)
+{
+    int *order = (int *)malloc(nodes->count * sizeof(int));
+    unsigned int state, tail = 1, word;
+    const trieNode *source;
+    acNode *node;
+    int child;
+
+    automaton->stateCount = nodes->count;
+    automaton->nodes = (acNode *)calloc(nodes->count, sizeof(acNode));
+    automaton->firstOutput = (int *)malloc(nodes->count * sizeof(int));
+    automaton->dictLink = (int *)malloc(nodes->count * sizeof(int));
+
+    if (!order || !automaton->nodes || !automaton->firstOutput ||
+        !automaton->dictLink)
+    {
+        free(order);
+        return false;
+    }
+
+    order[AC_ROOT] = AC_ROOT;
+
+    // the children of a state are queued one after the other, in the order
+    // of their bytes
+    for (state = 0; state < nodes->count; state++)
+    {
+        source = nodes->nodes + order[state];
+        node = automaton->nodes + state;
+        node->firstChild = tail;
+        automaton->firstOutput[state] = source->output;
+
+        for (child = source->firstChild; child != AC_NONE;
+             child = nodes->nodes[child].sibling)
+        {
+            node->children[nodes->nodes[child].byte / 64] |=
+                (uint64_t)1 << nodes->nodes[child].byte % 64;
+            order[tail++] = child;
+        }
+
+        for (word = 1; word < AC_ALPHABET / 64; word++)
+        {
+            node->rank[word] = node->rank[word - 1] +
+                               __builtin_popcountll(node->children[word - 1]);
+        }
+    }
+
+    free(order);
+
+    return true;
+}
+
+/**
+ * @brief the transition of a sparse automaton from a state on a byte.
+ *
+ * @param automaton a sparse automaton, linked up to the states shallower
+ * than the one reached.
+ * @param state the state.
+ * @param byte the byte.
+ * @return int the next state.
+ */
+static inline int sparseNext(const acAutomaton *automaton, int state,
+                             unsigned char byte)
+{
+    uint64_t bit = (uint64_t)1 << byte % 64, word;
+    const acNode *node;
+
+    // a byte without a child leads where it does from the failure state
+    while (state != AC_ROOT)
+    {
+        node = automaton->nodes + state;
+        word = node->children[byte / 64];
+
+        if (word & bit)
+        {
+            return node->firstChild + node->rank[byte / 64] +
+                   __builtin_popcountll(word & (bit - 1));
+        }
+
+        state = node->fail;
+    }
+
+    return automaton->delta[byte];
+}
+
+/**
+ * @brief compute the failure function and the dictionary links in BFS
+ * order, and the root's row of transitions.
+ *
+ * @param automaton a sparse automaton whose states are numbered.
+ * @return true on success.
+ */
+static bool linkStates(acAutomaton *automaton)
+{
+    unsigned int state, word, byte;
+    int child, fail;
+    uint64_t bits;
+
+    if (!(automaton->delta = (int *)malloc(AC_ALPHABET * sizeof(int))))
+    {
+        return false;
+    }
+
+    for (byte = 0; byte < AC_ALPHABET; byte++)
+    {
+        automaton->delta[byte] = AC_ROOT;
+    }
+
+    automaton->nodes[AC_ROOT].fail = AC_ROOT;
+    automaton->dictLink[AC_ROOT] = AC_ROOT;
+
+    // a state's failure state is shallower, so it is linked already
+    for (state = 0; state < automaton->stateCount; state++)
+    {
+        child = automaton->nodes[state].firstChild;
+
+        for (word = 0; word < AC_ALPHABET / 64; word++)
+        {
+            for (bits = automaton->nodes[state].children[word]; bits;
+                 bits &= bits - 1, child++)
+            {
+                byte = word * 64 + __builtin_ctzll(bits);
+
+                if (state == AC_ROOT)
+                {
+                    automaton->delta[byte] = child;
+                    fail = AC_ROOT;
+                }
+                else
+                {
+                    fail = sparseNext(automaton, automaton->nodes[state].fail,
+                                      byte);
+                }
+
+                automaton->nodes[child].fail = fail;
+                automaton->dictLink[child] =
+                    automaton->firstOutput[fail] != AC_NONE
+                        ? fail
+                        : automaton->dictLink[fail];
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief turn a linked sparse automaton into a full one, with a row of
+ * transitions per state.
+ *
+ * @param automaton a sparse automaton.
+ * @return true on success.
+ */
+static bool fillTable(acAutomaton *automaton)
+{
+    unsigned int state, word;
+    int *delta, *row, child;
+    uint64_t bits;
+
+    if (!(delta = (int *)realloc(automaton->delta,
+                                 (size_t)automaton->stateCount * AC_ALPHABET *
+                                     sizeof(int))))
+    {
+        return false;
+    }
+
+    automaton->delta = delta;
+
+    // the root's row is complete, and every failure state is shallower
+    for (state = 1; state < automaton->stateCount; state++)
+    {
+        row = delta + (size_t)state * AC_ALPHABET;
+        memcpy(row, delta + (size_t)automaton->nodes[state].fail * AC_ALPHABET,
+               AC_ALPHABET * sizeof(int));
+        child = automaton->nodes[state].firstChild;
+
+        for (word = 0; word < AC_ALPHABET / 64; word++)
+        {
+            for (bits = automaton->nodes[state].children[word]; bits;
+                 bits &= bits - 1)
+            {
+                row[word * 64 + __builtin_ctzll(bits)] = child++;
+            }
+        }
+    }
+
+    free(automaton->nodes);
+    automaton->nodes = NULL;
+    automaton->layout = AC_LAYOUT_FULL;
+
+    return true;
+}
+
+/**
+ * @brief build a matcher of the arena.
+ *
+ * @param arena a sealed arena.
+ * @param engine the engine it scans with, or ENGINE_AUTO.
+ * @param layout the layout of its automaton, or AC_LAYOUT_AUTO.
+ * @return acAutomaton* the matcher, or NULL on failure.
+ */
+static acAutomaton *buildMatcher(const sigArena *arena, matchEngine engine,
+                                 acLayout layout)
+{
+    acAutomaton *automaton = (acAutomaton *)calloc(1, sizeof(acAutomaton));
+    trie nodes = {NULL, 0, INITIAL_STATES};
+    unsigned int index;
+    bool ok = automaton != NULL;
+    keyStats stats;
+
+    if (!ok)
+    {
+        return NULL;
+    }
+
+    keyStatsCollect(&stats, arena);
+
+    automaton->arena = arena;
+    automaton->patternCount = arena->count;
+    automaton->maxLength = stats.maxLength;
+    automaton->engine = engine == ENGINE_AUTO ? engineChoose(&stats) : engine;
+
+    // the naive engine only needs the arena's index
+    if (automaton->engine != ENGINE_AUTOMATON)
+    {
+        if (automaton->engine == ENGINE_SHIFT &&
+            !(automaton->shift = shiftBuild(arena, &stats)))
+        {
+            acFree(automaton);
+            return NULL;
+        }
+
+        return automaton;
+    }
+
+    automaton->nextOutput = (int *)calloc(automaton->patternCount + 1,
+                                          sizeof(int));
+    nodes.nodes = (trieNode *)malloc(nodes.capacity * sizeof(trieNode));
+    automaton->prefilter = (acPrefilter *)malloc(sizeof(acPrefilter));
+
+    ok = automaton->nextOutput && nodes.nodes && automaton->prefilter &&
+         addNode(&nodes, 0) == AC_ROOT;
+
+    for (index = 0; ok && index < arena->count; index++)
+    {
+        automaton->nextOutput[index] = AC_NONE;
+
+        if (acVirus(automaton, index)->SigSize > 0)
+        {
+            ok = insertPattern(&nodes, automaton, index);
+        }
+    }
+
+    ok = ok && numberStates(&nodes, automaton);
+    free(nodes.nodes);
+
+    if (layout == AC_LAYOUT_AUTO)
+    {
+        layout = automaton->stateCount <= AC_FULL_MAX_STATES
+                     ? AC_LAYOUT_FULL
+                     : AC_LAYOUT_SPARSE;
+    }
+
+    automaton->layout = AC_LAYOUT_SPARSE;
+
+    if (!ok || !linkStates(automaton) ||
+        (layout == AC_LAYOUT_FULL && !fillTable(automaton)))
+    {
+        acFree(automaton);
+        return NULL;
+    }
+
+    prefilterBuild(automaton->prefilter, arena);
+
+    return automaton;
+}
+
+acAutomaton *acBuild(const sigArena *arena)
+{
+    return buildMatcher(arena, engineCurrent(), selectedLayout);
+}
+
+acAutomaton *acBuildEngine(const sigArena *arena, matchEngine engine)
+{
+    return buildMatcher(arena, engine, selectedLayout);
+}
+
+acAutomaton *acBuildLayout(const sigArena *arena, acLayout layout)
+{
+    return buildMatcher(arena, ENGINE_AUTOMATON, layout);
+}
+
+bool acLayoutSelect(acLayout layout)
+{
+    if (layout > AC_LAYOUT_AUTO)
+    {
+        return false;
+    }
+
+    selectedLayout = layout;
+
+    return true;
+}
+
+acLayout acLayoutCurrent()
+{
+    return selectedLayout;
+}
+
+const char *acLayoutName(acLayout layout)
+{
+    return layout <= AC_LAYOUT_AUTO ? layoutNames[layout] : "unknown";
+}
+
+size_t acMemory(const acAutomaton *automaton)
+{
+    size_t rows = automaton->layout == AC_LAYOUT_FULL ? automaton->stateCount
+                                                      : 1;
+
+    if (automaton->engine != ENGINE_AUTOMATON)
+    {
+        return automaton->shift ? shiftMemory(automaton->shift) : 0;
+    }
+
+    return rows * AC_ALPHABET * sizeof(int) +
+           (automaton->layout == AC_LAYOUT_SPARSE
+                ? automaton->stateCount * sizeof(acNode)
+                : 0) +
+           automaton->stateCount * 2 * sizeof(int) +
+           (automaton->patternCount + 1) * sizeof(int) + sizeof(acPrefilter);
+}
+
+void acFree(acAutomaton *automaton)
+{
+    if (automaton)
+    {
+        free(automaton->delta);
+        free(automaton->nodes);
+        free(automaton->firstOutput);
+        free(automaton->nextOutput);
+        free(automaton->dictLink);
+        free(automaton->prefilter);
+        shiftFree(automaton->shift);
+        free(automaton);
+    }
+}
+
+/**
+ * @brief scan a buffer with the automaton.
+ *
+ * @param automaton the automaton.
+ * @param buffer the buffer.
+ * @param size its size.
+ * @param hits receives the hits.
+ * @param stats counts the checks of every virus, unless NULL.
+ * @return size_t the number of hits appended.
+ */
+static size_t automatonScan(const acAutomaton *automaton,
+                            const unsigned char *buffer, size_t size,
+                            hitBuffer *hits, scanStats *stats)
+{
+    size_t first = hits->count, i, start;
+    int state = AC_ROOT, output, index;
+    hitBuffer undecided = {0};
+    patternResult result;
+    const sigPattern *pattern;
+    const virus *vir;
+    const acPrefilter *prefilter = automaton->prefilter;
+    bool skipping = prefilter && prefilter->enabled &&
+                    prefilterCurrent() != PREFILTER_OFF;
+    bool sparse = automaton->layout == AC_LAYOUT_SPARSE;
+
+    for (i = 0; i < size; i++)
+    {
+        // nothing is partially matched in the root, so jump to the next
+        // offset where a signature may start
+        if (skipping && state == AC_ROOT &&
+            (i = prefilterFind(prefilter, buffer, i, size)) == size)
+        {
+            break;
+        }
+
+        state = sparse ? sparseNext(automaton, state, buffer[i])
+                       : automaton->delta[state * AC_ALPHABET + buffer[i]];
+
+        output = automaton->firstOutput[state] != AC_NONE
+                     ? state
+                     : automaton->dictLink[state];
+
+        // every state on the dictionary chain is a signature ending at i
+        while (output != AC_ROOT)
+        {
+            for (index = automaton->firstOutput[output]; index != AC_NONE;
+                 index = automaton->nextOutput[index])
+            {
+                vir = acVirus(automaton, index);
+                statsAttempt(stats, index);
+                result = PATTERN_MATCH;
+
+                if (!(vir->SigSize & SIG_PATTERN))
+                {
+                    start = i + 1 - vir->SigSize;
+                }
+                else
+                {
+                    // the anchor of a pattern is at a fixed offset from its
+                    // first byte, which a previous window may have held
+                    pattern = virusPattern(vir);
+
+                    if (i + 1 < pattern->anchorLength + pattern->anchorOffset)
+                    {
+                        continue;
+                    }
+
+                    start = i + 1 - pattern->anchorLength -
+                            pattern->anchorOffset;
+
+                    if ((result = patternMatch(pattern, buffer + start,
+                                               size - start)) ==
+                        PATTERN_MISMATCH)
+                    {
+                        continue;
+                    }
+                }
+
+                if (!hitAppend(result == PATTERN_UNDECIDED ? &undecided : hits,
+                               index, start))
+                {
+                    hitFree(&undecided);
+                    hits->count = first;
+                    return 0;
+                }
+            }
+
+            output = automaton->dictLink[output];
+        }
+    }
+
+    // hits are found by their last byte, they are sorted by their first
+    return engineFinish(automaton->arena, buffer, size, &undecided, hits,
+                        first);
+}
+
+size_t acScan(const acAutomaton *automaton, const unsigned char *buffer,
+              size_t size, hitBuffer *hits)
+{
+    scanStats *stats = statsThread();
+    double start = stats ? statsClock() : 0;
+    size_t count;
+
+    switch (automaton->engine)
+    {
+    case ENGINE_SHIFT:
+        count = shiftScan(automaton->shift, automaton->arena, buffer, size,
+                          hits, stats);
+        break;
+    case ENGINE_NAIVE:
+        count = naiveScan(automaton->arena, buffer, size, hits, stats);
+        break;
+    default:
+        count = automatonScan(automaton, buffer, size, hits, stats);
+        break;
+    }
+
+    if (stats)
+    {
+        stats->bytes += size;
+        stats->scanSeconds += statsClock() - start;
+    }
+
+    return count;
+}
@@ -0,0 +1,281 @@
+/**
+NAME
+    benchCorpus - generates the inputs of the virusDetector benchmark.
+SYNOPSIS
+    benchCorpus -sigs COUNT L|B SIGFILE
+    benchCorpus -corpus MEGABYTES SAMPLE FILE
+    benchCorpus -patterns MEGABYTES SIGFILE FILE
+DESCRIPTION
+    benchCorpus writes synthetic inputs from fixed seeds, so every run of the
+    benchmark scans the same bytes.
+    -sigs - write COUNT random signatures of 8 to 32 bytes to SIGFILE, in the
+    VIRL (L) or the VIRB (B) format.
+    -corpus - write MEGABYTES of random bytes to FILE, with a copy of SAMPLE
+    at the start of every megabyte, so the corpus holds real viruses.
+    -patterns - write the patterns whose gaps are the costliest to check to
+    SIGFILE, in the VIRL format, and MEGABYTES of the byte they all match
+    over and over to FILE.
+EXAMPLES
+    benchCorpus -sigs 1000 L sigs-1000-L
+    benchCorpus -corpus 64 files/infected corpus-64
+    benchCorpus -patterns 4 sigs-patterns corpus-patterns
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIGS_SEED 0x9e3779b97f4a7c15ULL
+#define CORPUS_SEED 0xd1b54a32d192ed03ULL
+#define MIN_SIG 8
+#define MAX_SIG 32
+#define NAME_SIZE 16
+#define MEGABYTE (1 << 20)
+#define SIG_PATTERN 0x8000
+#define PATTERN_SIZE 512
+#define PATTERN_BYTE 0xc3
+#define PATTERN_WIDE "c3 {0-255} ?? {0-255} ?? {0-255} ff"
+#define PATTERN_LONG_GAPS 20
+
+#define PRINT_ERROR(MSG) fprintf(stderr, "!> %s\n", MSG)
+
+/**
+ * @brief the next number of a xorshift64 generator.
+ *
+ * @param state the generator's state.
+ * @return uint64_t a pseudo-random number.
+ */
+uint64_t nextRandom(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state;
+}
+
+/**
+ * @brief fill a buffer with pseudo-random bytes.
+ *
+ * @param state the generator's state.
+ * @param buffer a buffer.
+ * @param size the size of the buffer.
+ */
+void fillRandom(uint64_t *state, unsigned char *buffer, size_t size)
+{
+    uint64_t value = 0;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (i % 8 == 0)
+        {
+            value = nextRandom(state);
+        }
+
+        buffer[i] = value >> (i % 8 * 8);
+    }
+}
+
+/**
+ * @brief write random signatures in the format of a signatures file.
+ *
+ * @param count the number of signatures.
+ * @param bigEndian use the VIRB format rather than VIRL?
+ * @param path the signatures file.
+ * @return true on success.
+ */
+bool writeSignatures(unsigned int count, bool bigEndian, const char *path)
+{
+    unsigned char sig[MAX_SIG], size[2];
+    char name[NAME_SIZE];
+    uint64_t state = SIGS_SEED;
+    unsigned int i;
+    unsigned int length;
+    bool ok;
+    FILE *file = fopen(path, "w");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    ok = fwrite(bigEndian ? "VIRB" : "VIRL", 1, 4, file) == 4;
+
+    for (i = 0; i < count && ok; i++)
+    {
+        length = MIN_SIG + nextRandom(&state) % (MAX_SIG - MIN_SIG + 1);
+        size[bigEndian ? 1 : 0] = length & 0xff;
+        size[bigEndian ? 0 : 1] = length >> 8;
+
+        memset(name, 0, NAME_SIZE);
+        snprintf(name, NAME_SIZE, "bench%u", i);
+        fillRandom(&state, sig, length);
+
+        ok = fwrite(size, 1, 2, file) == 2 &&
+             fwrite(name, 1, NAME_SIZE, file) == NAME_SIZE &&
+             fwrite(sig, 1, length, file) == length;
+    }
+
+    return fclose(file) == 0 && ok;
+}
+
+/**
+ * @brief write random megabytes, each starting with a copy of a sample.
+ *
+ * @param megabytes the size of the corpus.
+ * @param samplePath the sample file.
+ * @param path the corpus file.
+ * @return true on success.
+ */
+bool writeCorpus(unsigned long megabytes, const char *samplePath,
+                 const char *path)
+{
+    unsigned char *buffer = (unsigned char *)malloc(MEGABYTE);
+    unsigned char *sample = (unsigned char *)malloc(MEGABYTE);
+    uint64_t state = CORPUS_SEED;
+    size_t sampleSize = 0;
+    unsigned long i;
+    bool ok = buffer && sample;
+    FILE *file = fopen(samplePath, "r"), *output = NULL;
+
+    if (ok && file)
+    {
+        sampleSize = fread(sample, 1, MEGABYTE, file);
+    }
+
+    if (file)
+    {
+        fclose(file);
+    }
+
+    ok = ok && sampleSize > 0 && (output = fopen(path, "w"));
+
+    for (i = 0; i < megabytes && ok; i++)
+    {
+        fillRandom(&state, buffer, MEGABYTE);
+        memcpy(buffer, sample, sampleSize);
+
+        ok = fwrite(buffer, 1, MEGABYTE, output) == MEGABYTE;
+    }
+
+    if (output && fclose(output) != 0)
+    {
+        ok = false;
+    }
+
+    free(buffer);
+    free(sample);
+
+    return ok;
+}
+
+/**
+ * @brief write the costliest patterns, and megabytes of their first byte.
+ *
+ * every byte of the text starts a match of the patterns that fails only at
+ * their last byte: one has the widest gaps, the other the most of them.
+ *
+ * @param megabytes the size of the text.
+ * @param sigPath the signatures file.
+ * @param path the text file.
+ * @return true on success.
+ */
+bool writePatterns(unsigned long megabytes, const char *sigPath,
+                   const char *path)
+{
+    char texts[2][PATTERN_SIZE], name[NAME_SIZE];
+    unsigned char *buffer = (unsigned char *)malloc(MEGABYTE), size[2];
+    size_t length;
+    unsigned long i;
+    bool ok = buffer != NULL;
+    FILE *file = fopen(sigPath, "w"), *output = NULL;
+
+    strcpy(texts[0], PATTERN_WIDE);
+    strcpy(texts[1], "c3");
+
+    for (i = 0; i < PATTERN_LONG_GAPS; i++)
+    {
+        strcat(texts[1], " ?? {0-40}");
+    }
+
+    strcat(texts[1], " ff");
+
+    ok = ok && file && fwrite("VIRL", 1, 4, file) == 4;
+
+    for (i = 0; i < 2 && ok; i++)
+    {
+        length = strlen(texts[i]);
+        size[0] = length & 0xff;
+        size[1] = (length | SIG_PATTERN) >> 8;
+
+        memset(name, 0, NAME_SIZE);
+        snprintf(name, NAME_SIZE, "pattern%lu", i);
+
+        ok = fwrite(size, 1, 2, file) == 2 &&
+             fwrite(name, 1, NAME_SIZE, file) == NAME_SIZE &&
+             fwrite(texts[i], 1, length, file) == length;
+    }
+
+    if (file && fclose(file) != 0)
+    {
+        ok = false;
+    }
+
+    ok = ok && (output = fopen(path, "w"));
+
+    if (buffer)
+    {
+        memset(buffer, PATTERN_BYTE, MEGABYTE);
+    }
+
+    for (i = 0; i < megabytes && ok; i++)
+    {
+        ok = fwrite(buffer, 1, MEGABYTE, output) == MEGABYTE;
+    }
+
+    if (output && fclose(output) != 0)
+    {
+        ok = false;
+    }
+
+    free(buffer);
+
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = false;
+
+    if (argc == 5 && !strcmp(argv[1], "-sigs") &&
+        (!strcmp(argv[3], "L") || !strcmp(argv[3], "B")))
+    {
+        ok = writeSignatures(atoi(argv[2]), argv[3][0] == 'B',
+                             argv[4]);
+    }
+    else if (argc == 5 && !strcmp(argv[1], "-corpus"))
+    {
+        ok = writeCorpus(strtoul(argv[2], NULL, 10), argv[3], argv[4]);
+    }
+    else if (argc == 5 && !strcmp(argv[1], "-patterns"))
+    {
+        ok = writePatterns(strtoul(argv[2], NULL, 10), argv[3], argv[4]);
+    }
+    else
+    {
+        PRINT_ERROR("usage: benchCorpus -sigs COUNT L|B SIGFILE | "
+                    "-corpus MEGABYTES SAMPLE FILE | "
+                    "-patterns MEGABYTES SIGFILE FILE");
+        return 1;
+    }
+
+    if (!ok)
+    {
+        PRINT_ERROR("failed writing the file");
+    }
+
+    return !ok;
+}
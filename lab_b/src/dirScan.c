@@ -0,0 +1,838 @@
+/**
+ * a parallel scan of a directory tree.
+ *
+ * the calling thread walks the tree and queues a task per file on a
+ * work-stealing pool. a big file is split into segments queued on the deque
+ * of the worker that opened it, so idle workers steal them instead of
+ * waiting for a single thread to finish the file. results are kept per file
+ * and per segment, and printed by the calling thread in the order of the
+ * walk as soon as every file before them is done.
+ *
+ * when looking for identical files, every file that is scanned shares its
+ * verdict. a file with the inode of one seen before is known to be a copy
+ * while walking. a file with the size of one seen before is hashed before
+ * it is scanned, and so is that first file, once, so files of a unique size
+ * are never hashed. a file with the size and hash of one seen before is
+ * compared with it byte by byte, as the hash isn't collision-resistant, and
+ * is only a copy if they are the same. a copy waits for the verdict of the
+ * file it copies instead of being scanned, even if that file is still being
+ * scanned, and is reported with its hits.
+ *
+ * with a blocklist, a file is hashed with SHA-256 once it is opened, and a
+ * listed file is finished without being scanned. a copy found by its inode
+ * or its content shares that verdict as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/limits.h> // for PATH_MAX
+#include <dirent.h>       // for scandir
+#include <fcntl.h>        // for open
+#include <unistd.h>       // for close and sysconf
+#include <sys/stat.h>     // for lstat and fstat
+#include "../include/dirScan.h"
+#include "../include/workPool.h"
+#include "../include/scanDedup.h"
+
+#define INITIAL_FILES 256
+
+struct treeScan;
+struct fileJob;
+
+// the verdict of a scanned file, shared with its copies
+typedef struct sharedVerdict
+{
+    struct sharedVerdict *same; // of the copy this file turned out to be
+    struct sharedVerdict *next; // in the list of the scan's verdicts
+    bool done;                  // guarded by the scan's lock
+    bool failed;
+    hitBuffer hits;             // of the whole file
+    struct fileJob *copies;     // waiting for it, linked by nextCopy
+    char *path;                 // of the first file of its size, or of a
+                                // hashed file, to compare copies with
+    bool hashed;                // has that file been hashed? guarded by the
+                                // scan's lock
+    bool knownBad;              // is its digest on the blocklist?
+    unsigned char digest[SHA256_SIZE];
+} sharedVerdict;
+
+typedef struct fileJob
+{
+    struct treeScan *scan;
+    char *path;
+    int fd;
+    struct stat info;   // as the file was opened
+    int segmentCount;
+    int segmentsLeft;   // guarded by the scan's lock
+    hitBuffer *segments; // the hits of every segment, in file order
+    struct segmentJob *jobs;
+    bool failed;
+    bool done;          // guarded by the scan's lock
+    sharedVerdict *verdict; // its own, or the one of the file it copies
+    sharedVerdict *sameSize; // of the first file of its size, if not this
+    bool copy;          // reported with the verdict of another file
+    bool sameInode;     // a copy found by its inode, not its content
+    struct fileJob *nextCopy;
+    bool knownBad;      // its digest is on the blocklist, it isn't scanned
+    unsigned char digest[SHA256_SIZE];
+} fileJob;
+
+typedef struct segmentJob
+{
+    fileJob *file;
+    int index;
+} segmentJob;
+
+typedef struct treeScan
+{
+    const acAutomaton *matcher;
+    scanCache *cache;
+    const hashSet *blocklist;
+    workPool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t finished; // signaled when a file is done
+    fileJob **files;         // in walk order, NULL once reported
+    size_t count, capacity, reported;
+    fileHandler onFile;
+    hitHandler onHit;
+    digestHandler onDigest;
+    void *context;
+    treeSummary *summary;
+    bool dedup;
+    dedupTable inodes;       // of the walked files, used by the walk only
+    dedupTable sizes;        // the first file of every size, the same
+    dedupTable contents;     // of the hashed files, guarded by lock
+    unsigned long long hashed; // files hashed, guarded by lock
+    sharedVerdict *verdicts; // all of them
+} treeScan;
+
+int defaultThreadCount()
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return online > 0 ? (int)online : 1;
+}
+
+/**
+ * @brief append a hit to the hits of a segment.
+ *
+ * @param context the segment's hit buffer.
+ * @param virusIndex the virus found.
+ * @param offset the first byte of the signature in the file.
+ */
+static void addHit(void *context, unsigned int virusIndex,
+                   unsigned long long offset)
+{
+    hitAppend((hitBuffer *)context, virusIndex, offset);
+}
+
+/**
+ * @brief follow the verdicts of files that turned out to be copies to the
+ * verdict they share.
+ */
+static sharedVerdict *resolveVerdict(sharedVerdict *verdict)
+{
+    while (verdict->same)
+    {
+        verdict = verdict->same;
+    }
+
+    return verdict;
+}
+
+/**
+ * @brief make a copy wait for a verdict, or finish it if the verdict is
+ * known. the scan's lock is held.
+ *
+ * @param verdict the verdict.
+ * @param copy a copy of the file it belongs to.
+ */
+static void awaitVerdict(sharedVerdict *verdict, fileJob *copy)
+{
+    verdict = resolveVerdict(verdict);
+
+    if (verdict->done)
+    {
+        copy->done = true;
+        pthread_cond_broadcast(&copy->scan->finished);
+    }
+    else
+    {
+        copy->nextCopy = verdict->copies;
+        verdict->copies = copy;
+    }
+}
+
+/**
+ * @brief share the verdict of a scanned file, and finish its copies. the
+ * scan's lock is held.
+ *
+ * @param file a file whose segments are all scanned.
+ */
+static void shareVerdict(fileJob *file)
+{
+    sharedVerdict *verdict = file->verdict;
+    fileJob *copy;
+    int i;
+    size_t j;
+
+    verdict->done = true;
+    verdict->failed = file->failed;
+    verdict->knownBad = file->knownBad;
+    memcpy(verdict->digest, file->digest, SHA256_SIZE);
+
+    for (i = 0; i < file->segmentCount; i++)
+    {
+        for (j = 0; j < file->segments[i].count; j++)
+        {
+            hitAppend(&verdict->hits, file->segments[i].hits[j].virusIndex,
+                      file->segments[i].hits[j].offset);
+        }
+    }
+
+    for (copy = verdict->copies; copy; copy = copy->nextCopy)
+    {
+        copy->done = true;
+    }
+
+    verdict->copies = NULL;
+}
+
+/**
+ * @brief mark one segment of a file as scanned, and the file as done if it
+ * was the last one.
+ *
+ * @param file a file.
+ * @param failed did the segment fail?
+ */
+static void finishSegment(fileJob *file, bool failed)
+{
+    treeScan *scan = file->scan;
+
+    pthread_mutex_lock(&scan->lock);
+
+    file->failed = file->failed || failed;
+
+    if (--file->segmentsLeft == 0)
+    {
+        if (file->fd != -1)
+        {
+            close(file->fd);
+            file->fd = -1;
+        }
+
+        if (file->verdict)
+        {
+            shareVerdict(file);
+        }
+
+        file->done = true;
+        pthread_cond_broadcast(&scan->finished);
+    }
+
+    pthread_mutex_unlock(&scan->lock);
+}
+
+/**
+ * @brief scan a single segment of a file.
+ *
+ * @param argument a segmentJob.
+ * @param worker unused.
+ */
+static void scanSegment(void *argument, int worker)
+{
+    segmentJob *job = (segmentJob *)argument;
+    fileJob *file = job->file;
+    off_t start = (off_t)job->index * SEGMENT_SIZE;
+    off_t end = start + SEGMENT_SIZE < file->info.st_size
+                    ? start + SEGMENT_SIZE
+                    : file->info.st_size;
+    bool ok;
+
+    ok = streamScanRange(file->fd, start, end, file->scan->matcher, addHit,
+                         &file->segments[job->index]);
+
+    finishSegment(file, !ok);
+}
+
+/**
+ * @brief hash the first file of a size, which wasn't hashed when it was
+ * scanned, the first time another file turns out to have its size.
+ *
+ * @param scan a tree scan.
+ * @param first the verdict of the first file.
+ * @param size the size of the other file.
+ */
+static void hashFirst(treeScan *scan, sharedVerdict *first, off_t size)
+{
+    struct stat info;
+    uint64_t hash;
+    bool claimed;
+    int fd;
+
+    pthread_mutex_lock(&scan->lock);
+    claimed = !first->hashed;
+    first->hashed = true;
+    pthread_mutex_unlock(&scan->lock);
+
+    if (!claimed || (fd = open(first->path, O_RDONLY)) == -1)
+    {
+        return;
+    }
+
+    if (fstat(fd, &info) == 0 && info.st_size == size &&
+        hashContent(fd, size, &hash))
+    {
+        pthread_mutex_lock(&scan->lock);
+        scan->hashed++;
+
+        if (!dedupFind(&scan->contents, size, hash))
+        {
+            dedupInsert(&scan->contents, size, hash, first);
+        }
+
+        pthread_mutex_unlock(&scan->lock);
+    }
+
+    close(fd);
+}
+
+/**
+ * @brief compare an open file with the file of a verdict byte by byte.
+ *
+ * @param file an open file.
+ * @param original the verdict of a hashed file of the same size.
+ * @return true if the files have the same content.
+ */
+static bool compareOriginal(fileJob *file, const sharedVerdict *original)
+{
+    struct stat info;
+    bool same;
+    int fd;
+
+    if (!original->path || (fd = open(original->path, O_RDONLY)) == -1)
+    {
+        return false;
+    }
+
+    same = fstat(fd, &info) == 0 && info.st_size == file->info.st_size &&
+           sameContent(file->fd, fd, file->info.st_size);
+
+    close(fd);
+
+    return same;
+}
+
+/**
+ * @brief hash an open file and look for a file with the same content. a
+ * file with the size and hash of another is compared with it, so a crafted
+ * collision is scanned like any other file. a copy waits for the verdict of
+ * that file instead of being scanned, along with the hard links to it.
+ *
+ * @param file an open file with the size of a file seen before.
+ * @return true if the file is a copy, and is closed.
+ */
+static bool findCopy(fileJob *file)
+{
+    treeScan *scan = file->scan;
+    sharedVerdict *original;
+    fileJob *copies, *copy;
+    uint64_t hash;
+
+    // a file that can't be hashed is still scanned
+    if (!hashContent(file->fd, file->info.st_size, &hash))
+    {
+        return false;
+    }
+
+    hashFirst(scan, file->sameSize, file->info.st_size);
+
+    pthread_mutex_lock(&scan->lock);
+    scan->hashed++;
+
+    if (!(original = (sharedVerdict *)dedupFind(&scan->contents,
+                                                file->info.st_size, hash)))
+    {
+        // the path is kept to compare the copies with
+        if ((file->verdict->path = strdup(file->path)) &&
+            !dedupInsert(&scan->contents, file->info.st_size, hash,
+                         file->verdict))
+        {
+            free(file->verdict->path);
+            file->verdict->path = NULL;
+        }
+
+        pthread_mutex_unlock(&scan->lock);
+        return false;
+    }
+
+    // verdicts are only released once the tree is scanned, the original's
+    // path can be read while other files are hashed
+    pthread_mutex_unlock(&scan->lock);
+
+    if (!compareOriginal(file, original))
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&scan->lock);
+
+    // the file may be reported as soon as it waits, so it's closed first
+    close(file->fd);
+    file->fd = -1;
+    file->segmentCount = 0;
+    file->copy = true;
+
+    copies = file->verdict->copies;
+    file->verdict->copies = NULL;
+    file->verdict->same = original;
+
+    while ((copy = copies))
+    {
+        copies = copy->nextCopy;
+        awaitVerdict(original, copy);
+    }
+
+    awaitVerdict(original, file);
+
+    pthread_mutex_unlock(&scan->lock);
+
+    return true;
+}
+
+/**
+ * @brief look up the SHA-256 of an open file on the blocklist, and finish
+ * the file without scanning it if it is listed.
+ *
+ * @param file an open file.
+ * @return true if the file is listed, and is finished.
+ */
+static bool checkDigest(fileJob *file)
+{
+    // a file that can't be hashed is still scanned
+    if (!sha256File(file->fd, file->digest) ||
+        !hashSetContains(file->scan->blocklist, file->digest))
+    {
+        return false;
+    }
+
+    file->knownBad = true;
+    file->segmentCount = 0;
+    finishSegment(file, false);
+
+    return true;
+}
+
+/**
+ * @brief open a file, split it into segments, queue all of them but the
+ * first on the current worker and scan the first one.
+ *
+ * @param argument a fileJob.
+ * @param worker the worker running the task.
+ */
+static void scanFileTask(void *argument, int worker)
+{
+    fileJob *file = (fileJob *)argument;
+    int i;
+
+    file->segmentCount = 1;
+    file->segmentsLeft = 1;
+
+    if ((file->fd = open(file->path, O_RDONLY)) == -1 ||
+        fstat(file->fd, &file->info) == -1)
+    {
+        file->segmentCount = 0;
+        finishSegment(file, true);
+        return;
+    }
+
+    if (file->sameSize && findCopy(file))
+    {
+        return;
+    }
+
+    if (file->scan->blocklist && checkDigest(file))
+    {
+        return;
+    }
+
+    if (file->info.st_size > SEGMENT_SIZE)
+    {
+        file->segmentCount = (file->info.st_size + SEGMENT_SIZE - 1) /
+                             SEGMENT_SIZE;
+    }
+
+    file->segments = (hitBuffer *)calloc(file->segmentCount,
+                                         sizeof(hitBuffer));
+    file->jobs = (segmentJob *)calloc(file->segmentCount, sizeof(segmentJob));
+
+    if (!file->segments || !file->jobs)
+    {
+        file->segmentCount = 0;
+        finishSegment(file, true);
+        return;
+    }
+
+    pthread_mutex_lock(&file->scan->lock);
+    file->segmentsLeft = file->segmentCount;
+    pthread_mutex_unlock(&file->scan->lock);
+
+    for (i = 0; i < file->segmentCount; i++)
+    {
+        file->jobs[i].file = file;
+        file->jobs[i].index = i;
+    }
+
+    // queued newest-first, so this worker continues from the front
+    for (i = file->segmentCount - 1; i > 0; i--)
+    {
+        if (!poolSubmit(file->scan->pool, scanSegment, &file->jobs[i], worker))
+        {
+            scanSegment(&file->jobs[i], worker);
+        }
+    }
+
+    scanSegment(&file->jobs[0], worker);
+}
+
+/**
+ * @brief report a finished file and release it.
+ *
+ * @param scan a tree scan.
+ * @param file a finished file.
+ */
+static void reportFile(treeScan *scan, fileJob *file)
+{
+    sharedVerdict *verdict = NULL;
+    bool infected = false;
+    int i;
+    size_t j;
+
+    for (i = 0; i < file->segmentCount && !infected; i++)
+    {
+        infected = file->segments[i].count > 0;
+    }
+
+    // a copy is reported as the file it copies
+    if (file->copy)
+    {
+        verdict = resolveVerdict(file->verdict);
+        file->failed = verdict->failed;
+        file->knownBad = verdict->knownBad;
+        memcpy(file->digest, verdict->digest, SHA256_SIZE);
+        infected = verdict->hits.count > 0;
+        scan->summary->sameInode += file->sameInode;
+        scan->summary->sameContent += !file->sameInode;
+    }
+
+    infected = infected || file->knownBad;
+    scan->summary->files++;
+    scan->summary->knownBad += file->knownBad;
+
+    if (scan->cache && !file->failed)
+    {
+        cacheRecord(scan->cache, &file->info,
+                    infected ? VERDICT_INFECTED : VERDICT_CLEAN);
+    }
+
+    if (file->failed)
+    {
+        scan->summary->failed++;
+        scan->onFile(scan->context, file->path, true);
+    }
+    else if (infected)
+    {
+        scan->summary->infected++;
+        scan->onFile(scan->context, file->path, false);
+
+        if (file->knownBad)
+        {
+            scan->onDigest(scan->context, file->digest);
+        }
+
+        for (j = 0; verdict && j < verdict->hits.count; j++)
+        {
+            scan->onHit(scan->context, verdict->hits.hits[j].virusIndex,
+                        verdict->hits.hits[j].offset);
+        }
+
+        for (i = 0; i < file->segmentCount; i++)
+        {
+            for (j = 0; j < file->segments[i].count; j++)
+            {
+                scan->onHit(scan->context,
+                            file->segments[i].hits[j].virusIndex,
+                            file->segments[i].hits[j].offset);
+            }
+        }
+    }
+
+    for (i = 0; i < file->segmentCount; i++)
+    {
+        hitFree(&file->segments[i]);
+    }
+
+    free(file->segments);
+    free(file->jobs);
+    free(file->path);
+    free(file);
+}
+
+/**
+ * @brief report finished files in walk order, up to the first file that
+ * is still being scanned.
+ *
+ * @param scan a tree scan.
+ * @param wait wait for every queued file to finish?
+ */
+static void reportFinished(treeScan *scan, bool wait)
+{
+    fileJob *file;
+
+    while (scan->reported < scan->count)
+    {
+        file = scan->files[scan->reported];
+
+        pthread_mutex_lock(&scan->lock);
+
+        while (wait && !file->done)
+        {
+            pthread_cond_wait(&scan->finished, &scan->lock);
+        }
+
+        if (!file->done)
+        {
+            pthread_mutex_unlock(&scan->lock);
+            return;
+        }
+
+        pthread_mutex_unlock(&scan->lock);
+
+        reportFile(scan, file);
+        scan->files[scan->reported++] = NULL;
+    }
+}
+
+/**
+ * @brief give a walked file the verdict of the file with its inode, as a
+ * copy, or a verdict of its own.
+ *
+ * @param scan a tree scan.
+ * @param file the file.
+ * @param info the file's status.
+ */
+static void findVerdict(treeScan *scan, fileJob *file,
+                        const struct stat *info)
+{
+    sharedVerdict *verdict;
+
+    if ((verdict = (sharedVerdict *)dedupFind(&scan->inodes, info->st_dev,
+                                              info->st_ino)))
+    {
+        file->verdict = verdict;
+        file->info = *info;
+        file->copy = true;
+        file->sameInode = true;
+        return;
+    }
+
+    // without a verdict of its own, the file is scanned as usual
+    if (!(verdict = (sharedVerdict *)calloc(1, sizeof(sharedVerdict))))
+    {
+        return;
+    }
+
+    verdict->next = scan->verdicts;
+    scan->verdicts = verdict;
+    file->verdict = verdict;
+
+    dedupInsert(&scan->inodes, info->st_dev, info->st_ino, verdict);
+
+    // only a file with the size of another one can be a copy
+    if ((file->sameSize = (sharedVerdict *)dedupFind(&scan->sizes,
+                                                     info->st_size, 0)))
+    {
+        return;
+    }
+
+    if ((verdict->path = strdup(file->path)) &&
+        !dedupInsert(&scan->sizes, info->st_size, 0, verdict))
+    {
+        free(verdict->path);
+        verdict->path = NULL;
+    }
+}
+
+/**
+ * @brief queue a file for scanning, unless the cache knows it is clean.
+ *
+ * @param scan a tree scan.
+ * @param path the file's path.
+ * @param info the file's status.
+ */
+static void queueFile(treeScan *scan, const char *path,
+                      const struct stat *info)
+{
+    fileJob *file;
+    fileJob **grown;
+    cacheVerdict verdict;
+
+    // nothing is printed for a clean file, it can be counted right away
+    if (scan->cache && cacheLookup(scan->cache, info, &verdict) &&
+        verdict == VERDICT_CLEAN)
+    {
+        // kept in the cache, which drops the files it wasn't given
+        cacheRecord(scan->cache, info, VERDICT_CLEAN);
+        scan->summary->files++;
+        scan->summary->unchanged++;
+        return;
+    }
+
+    file = (fileJob *)calloc(1, sizeof(fileJob));
+
+    if (!file || !(file->path = strdup(path)))
+    {
+        free(file);
+        return;
+    }
+
+    file->scan = scan;
+    file->fd = -1;
+
+    if (scan->dedup)
+    {
+        findVerdict(scan, file, info);
+    }
+
+    if (scan->count == scan->capacity)
+    {
+        scan->capacity = scan->capacity ? scan->capacity * 2 : INITIAL_FILES;
+        grown = (fileJob **)realloc(scan->files,
+                                    scan->capacity * sizeof(fileJob *));
+
+        if (!grown)
+        {
+            scan->capacity = scan->count;
+            free(file->path);
+            free(file);
+            return;
+        }
+
+        scan->files = grown;
+    }
+
+    scan->files[scan->count++] = file;
+
+    if (file->copy)
+    {
+        pthread_mutex_lock(&scan->lock);
+        awaitVerdict(file->verdict, file);
+        pthread_mutex_unlock(&scan->lock);
+    }
+    else if (!poolSubmit(scan->pool, scanFileTask, file, POOL_ANY_WORKER))
+    {
+        scanFileTask(file, 0);
+    }
+
+    // don't hold on to results that can already be printed
+    reportFinished(scan, false);
+}
+
+/**
+ * @brief walk a tree in name order, queueing every regular file. symbolic
+ * links are not followed.
+ *
+ * @param scan a tree scan.
+ * @param path the root of the tree.
+ */
+static void walkTree(treeScan *scan, const char *path)
+{
+    struct dirent **entries;
+    struct stat info;
+    char child[PATH_MAX];
+    int count, i;
+
+    if (lstat(path, &info) == -1)
+    {
+        return;
+    }
+
+    if (S_ISREG(info.st_mode))
+    {
+        queueFile(scan, path, &info);
+    }
+    else if (S_ISDIR(info.st_mode) &&
+             (count = scandir(path, &entries, NULL, alphasort)) != -1)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (strcmp(entries[i]->d_name, ".") &&
+                strcmp(entries[i]->d_name, "..") &&
+                snprintf(child, PATH_MAX, "%s/%s", path,
+                         entries[i]->d_name) < PATH_MAX)
+            {
+                walkTree(scan, child);
+            }
+
+            free(entries[i]);
+        }
+
+        free(entries);
+    }
+}
+
+bool scanTree(const char *root, const acAutomaton *matcher, int threadCount,
+              scanCache *cache, bool dedup, const hashSet *blocklist,
+              fileHandler onFile, hitHandler onHit, digestHandler onDigest,
+              void *context, treeSummary *summary)
+{
+    treeScan scan;
+    sharedVerdict *verdict;
+
+    memset(&scan, 0, sizeof(treeScan));
+    memset(summary, 0, sizeof(treeSummary));
+
+    scan.matcher = matcher;
+    scan.cache = cache;
+    scan.blocklist = blocklist;
+    scan.onFile = onFile;
+    scan.onHit = onHit;
+    scan.onDigest = onDigest;
+    scan.context = context;
+    scan.summary = summary;
+    scan.dedup = dedup;
+
+    if (!(scan.pool = poolCreate(threadCount)))
+    {
+        return false;
+    }
+
+    pthread_mutex_init(&scan.lock, NULL);
+    pthread_cond_init(&scan.finished, NULL);
+
+    walkTree(&scan, root);
+    reportFinished(&scan, true);
+
+    poolDestroy(scan.pool);
+
+    pthread_mutex_destroy(&scan.lock);
+    pthread_cond_destroy(&scan.finished);
+    free(scan.files);
+
+    summary->hashed = scan.hashed;
+
+    while ((verdict = scan.verdicts))
+    {
+        scan.verdicts = verdict->next;
+        hitFree(&verdict->hits);
+        free(verdict->path);
+        free(verdict);
+    }
+
+    dedupFree(&scan.inodes);
+    dedupFree(&scan.sizes);
+    dedupFree(&scan.contents);
+
+    return true;
+}
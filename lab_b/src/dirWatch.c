@@ -0,0 +1,568 @@
+/**
+ * scanning files as they are written, with inotify.
+ *
+ * the calling thread reads the events and keeps a table of the files that
+ * changed, each with the time of its last event. a burst of writes, or a
+ * write and then a rename, touches a single entry, and a file is queued
+ * only after it settled. the queue is the work pool with a cap on the files
+ * in it. a settled file that finds the queue full keeps waiting in the
+ * table, which is the only thing that grows when the workers fall behind,
+ * and a file that finds the table full is dropped and counted.
+ */
+
+#define _GNU_SOURCE // for ppoll
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/limits.h> // for PATH_MAX
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include "../include/dirWatch.h"
+#include "../include/workPool.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+#define FILE_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+#define GONE_EVENTS (IN_MOVED_FROM | IN_DELETE)
+#define EVENT_BUFFER (64 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+// a file that changed and wasn't queued yet
+typedef struct pendingFile
+{
+    char *path;
+    uint64_t hash;                // of the path
+    unsigned long long settledAt; // in milliseconds
+    bool stalled;                 // settled while the queue was full
+} pendingFile;
+
+typedef struct dirWatch
+{
+    const acAutomaton *matcher;
+    workPool *pool;
+    int inotify;
+    int wakeup;                   // an eventfd the workers signal when the
+                                  // watcher waits for room in the queue
+    char *const *directories;
+    int *descriptors;             // the watch descriptor of every directory
+    int count;
+    pendingFile *pending;         // unordered
+    size_t pendingCount;
+    pthread_mutex_t lock;         // guards queued, waiting, the summary and
+                                  // the reports
+    unsigned int queued;
+    bool waiting;
+    int threadCount;
+    hitBuffer *hits;              // per worker, and one for this thread
+    fileHandler onFile;
+    hitHandler onHit;
+    void *context;
+    watchSummary *summary;
+} dirWatch;
+
+typedef struct watchedFile
+{
+    dirWatch *watch;
+    char *path;
+} watchedFile;
+
+static volatile sig_atomic_t stopping = 0;
+static volatile sig_atomic_t reporting = 0;
+
+/**
+ * @brief ask the watch to stop.
+ */
+static void requestStop(int signal)
+{
+    stopping = 1;
+}
+
+/**
+ * @brief ask the watch to report its counters.
+ */
+static void requestStatus(int signal)
+{
+    reporting = 1;
+}
+
+/**
+ * @brief the time of a monotonic clock, in milliseconds.
+ */
+static unsigned long long now()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (unsigned long long)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+/**
+ * @brief FNV-1a of a path.
+ */
+static uint64_t hashPath(const char *path)
+{
+    uint64_t hash = FNV_OFFSET;
+
+    while (*path)
+    {
+        hash = (hash ^ (unsigned char)*path++) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief append a hit to a hit buffer.
+ */
+static void addHit(void *context, unsigned int virusIndex,
+                   unsigned long long offset)
+{
+    hitAppend((hitBuffer *)context, virusIndex, offset);
+}
+
+/**
+ * @brief scan a settled file and report it.
+ *
+ * @param argument a watchedFile.
+ * @param worker the worker running the task.
+ */
+static void scanWatched(void *argument, int worker)
+{
+    watchedFile *file = (watchedFile *)argument;
+    dirWatch *watch = file->watch;
+    hitBuffer *hits = &watch->hits[worker];
+    struct stat info;
+    bool vanished = false, failed = false, scanned = false;
+    uint64_t one = 1;
+    size_t i;
+    int fd;
+
+    hitClear(hits);
+
+    // a fifo moved in must not block the worker
+    if ((fd = open(file->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) == -1)
+    {
+        vanished = errno == ENOENT;
+        failed = !vanished;
+    }
+    else
+    {
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+        {
+            scanned = true;
+            failed = !streamScanFd(fd, watch->matcher, addHit, hits);
+        }
+
+        close(fd);
+    }
+
+    pthread_mutex_lock(&watch->lock);
+
+    watch->summary->files += scanned;
+    watch->summary->failed += failed;
+    watch->summary->vanished += vanished;
+    watch->summary->infected += !failed && hits->count > 0;
+
+    if (failed || hits->count > 0)
+    {
+        watch->onFile(watch->context, file->path, failed);
+    }
+
+    for (i = 0; !failed && i < hits->count; i++)
+    {
+        watch->onHit(watch->context, hits->hits[i].virusIndex,
+                     hits->hits[i].offset);
+    }
+
+    watch->queued--;
+
+    if (watch->waiting)
+    {
+        watch->waiting = false;
+        write(watch->wakeup, &one, sizeof(one));
+    }
+
+    pthread_mutex_unlock(&watch->lock);
+
+    free(file->path);
+    free(file);
+}
+
+/**
+ * @brief find a file in the table.
+ *
+ * @return long its index, or -1.
+ */
+static long findPending(dirWatch *watch, const char *path, uint64_t hash)
+{
+    size_t i;
+
+    for (i = 0; i < watch->pendingCount; i++)
+    {
+        if (watch->pending[i].hash == hash &&
+            !strcmp(watch->pending[i].path, path))
+        {
+            return (long)i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief remove an entry from the table, moving the last one to its place.
+ */
+static void removePending(dirWatch *watch, size_t index)
+{
+    free(watch->pending[index].path);
+    watch->pending[index] = watch->pending[--watch->pendingCount];
+}
+
+/**
+ * @brief handle an event about a file in a watched directory.
+ *
+ * @param watch the watch.
+ * @param event the event.
+ */
+static void noteEvent(dirWatch *watch, const struct inotify_event *event)
+{
+    char path[PATH_MAX];
+    pendingFile *entry;
+    uint64_t hash;
+    long index;
+    int i;
+
+    for (i = 0; i < watch->count && watch->descriptors[i] != event->wd; i++)
+    {
+    }
+
+    if (i == watch->count || !event->len || (event->mask & IN_ISDIR) ||
+        snprintf(path, PATH_MAX, "%s/%s", watch->directories[i],
+                 event->name) >= PATH_MAX)
+    {
+        return;
+    }
+
+    hash = hashPath(path);
+    index = findPending(watch, path, hash);
+
+    // a file that was renamed or deleted before it settled isn't scanned
+    if (event->mask & GONE_EVENTS)
+    {
+        if (index != -1)
+        {
+            removePending(watch, index);
+        }
+
+        return;
+    }
+
+    pthread_mutex_lock(&watch->lock);
+    watch->summary->events++;
+
+    if (index != -1)
+    {
+        watch->summary->merged++;
+        watch->pending[index].settledAt = now() + WATCH_SETTLE_MS;
+    }
+    else if (watch->pendingCount == WATCH_PENDING_MAX ||
+             !(watch->pending[watch->pendingCount].path = strdup(path)))
+    {
+        watch->summary->dropped++;
+    }
+    else
+    {
+        entry = &watch->pending[watch->pendingCount];
+        entry->hash = hash;
+        entry->settledAt = now() + WATCH_SETTLE_MS;
+        entry->stalled = false;
+        watch->pendingCount++;
+    }
+
+    pthread_mutex_unlock(&watch->lock);
+}
+
+/**
+ * @brief read the events waiting on the inotify descriptor.
+ *
+ * @param watch the watch.
+ */
+static void readEvents(dirWatch *watch)
+{
+    char buffer[EVENT_BUFFER]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    ssize_t length;
+    char *at;
+
+    while ((length = read(watch->inotify, buffer, sizeof(buffer))) > 0)
+    {
+        for (at = buffer; at < buffer + length;
+             at += sizeof(struct inotify_event) + event->len)
+        {
+            event = (const struct inotify_event *)at;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                pthread_mutex_lock(&watch->lock);
+                watch->summary->overflows++;
+                pthread_mutex_unlock(&watch->lock);
+            }
+            else
+            {
+                noteEvent(watch, event);
+            }
+        }
+    }
+}
+
+/**
+ * @brief queue the files that settled, as long as there is room.
+ *
+ * @param watch the watch.
+ * @return int milliseconds until the next file settles, 0 if the watcher
+ * should wait for room in the queue, or -1 if no file is waiting.
+ */
+static int queueSettled(dirWatch *watch)
+{
+    unsigned long long time = now(), next = 0;
+    watchedFile *file;
+    pendingFile *entry;
+    size_t i = 0;
+    bool full = false;
+
+    pthread_mutex_lock(&watch->lock);
+
+    while (i < watch->pendingCount)
+    {
+        entry = &watch->pending[i];
+
+        if (entry->settledAt > time)
+        {
+            next = !next || entry->settledAt < next ? entry->settledAt : next;
+            i++;
+            continue;
+        }
+
+        if ((full = watch->queued >= WATCH_QUEUE_MAX))
+        {
+            watch->summary->stalled += !entry->stalled;
+            entry->stalled = true;
+            i++;
+            continue;
+        }
+
+        if (!(file = (watchedFile *)malloc(sizeof(watchedFile))))
+        {
+            i++;
+            continue;
+        }
+
+        file->watch = watch;
+        file->path = entry->path;
+        entry->path = NULL;
+        watch->pending[i] = watch->pending[--watch->pendingCount];
+        watch->queued++;
+
+        if (watch->queued > watch->summary->queuePeak)
+        {
+            watch->summary->queuePeak = watch->queued;
+        }
+
+        // a file that can't be queued is scanned here, which takes the lock
+        pthread_mutex_unlock(&watch->lock);
+
+        if (!poolSubmit(watch->pool, scanWatched, file, POOL_ANY_WORKER))
+        {
+            scanWatched(file, watch->threadCount);
+        }
+
+        pthread_mutex_lock(&watch->lock);
+    }
+
+    // a worker that finishes a file wakes the watcher up
+    watch->waiting = full;
+
+    pthread_mutex_unlock(&watch->lock);
+
+    return full ? 0 : next ? (int)(next - time) : -1;
+}
+
+/**
+ * @brief watch the directories for files written or moved in.
+ *
+ * @param watch the watch.
+ * @return true if every directory is watched.
+ */
+static bool addWatches(dirWatch *watch)
+{
+    int i;
+
+    for (i = 0; i < watch->count; i++)
+    {
+        if ((watch->descriptors[i] = inotify_add_watch(
+                 watch->inotify, watch->directories[i],
+                 FILE_EVENTS | GONE_EVENTS | IN_ONLYDIR)) == -1)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief release everything but the summary.
+ */
+static void freeWatch(dirWatch *watch)
+{
+    size_t i;
+
+    for (i = 0; i < watch->pendingCount; i++)
+    {
+        free(watch->pending[i].path);
+    }
+
+    for (i = 0; watch->hits && i <= (size_t)watch->threadCount; i++)
+    {
+        hitFree(&watch->hits[i]);
+    }
+
+    if (watch->inotify != -1)
+    {
+        close(watch->inotify);
+    }
+
+    if (watch->wakeup != -1)
+    {
+        close(watch->wakeup);
+    }
+
+    free(watch->pending);
+    free(watch->descriptors);
+    free(watch->hits);
+}
+
+bool watchDirectories(char *const *directories, int count,
+                      const acAutomaton *matcher, int threadCount,
+                      fileHandler onFile, hitHandler onHit,
+                      watchStatusHandler onStatus, void *context,
+                      watchSummary *summary)
+{
+    struct sigaction action, previousInterrupt, previousTerminate,
+        previousStatus;
+    sigset_t stopSignals, previousMask;
+    struct pollfd waiting[2];
+    struct timespec timeout;
+    watchSummary snapshot;
+    dirWatch watch;
+    uint64_t wakeups;
+    int milliseconds;
+
+    memset(summary, 0, sizeof(watchSummary));
+    memset(&watch, 0, sizeof(dirWatch));
+    watch.matcher = matcher;
+    watch.directories = directories;
+    watch.count = count;
+    watch.onFile = onFile;
+    watch.onHit = onHit;
+    watch.context = context;
+    watch.summary = summary;
+    watch.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watch.wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    watch.descriptors = (int *)calloc(count, sizeof(int));
+    watch.pending = (pendingFile *)calloc(WATCH_PENDING_MAX,
+                                          sizeof(pendingFile));
+    watch.threadCount = threadCount;
+    watch.hits = (hitBuffer *)calloc(threadCount + 1, sizeof(hitBuffer));
+
+    if (watch.inotify == -1 || watch.wakeup == -1 || !watch.descriptors ||
+        !watch.pending || !watch.hits || !addWatches(&watch))
+    {
+        freeWatch(&watch);
+        return false;
+    }
+
+    // the signals are only taken by this thread, while it waits for events
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigaddset(&stopSignals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &previousMask);
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, &previousInterrupt);
+    sigaction(SIGTERM, &action, &previousTerminate);
+    action.sa_handler = requestStatus;
+    sigaction(SIGUSR1, &action, &previousStatus);
+
+    stopping = 0;
+    reporting = 0;
+
+    if ((watch.pool = poolCreate(threadCount)))
+    {
+        pthread_mutex_init(&watch.lock, NULL);
+
+        waiting[0].fd = watch.inotify;
+        waiting[0].events = POLLIN;
+        waiting[1].fd = watch.wakeup;
+        waiting[1].events = POLLIN;
+
+        while (!stopping)
+        {
+            if (reporting)
+            {
+                reporting = 0;
+                pthread_mutex_lock(&watch.lock);
+                snapshot = *summary;
+                pthread_mutex_unlock(&watch.lock);
+                onStatus(context, &snapshot);
+            }
+
+            milliseconds = queueSettled(&watch);
+            timeout.tv_sec = milliseconds / 1000;
+            timeout.tv_nsec = (milliseconds % 1000) * 1000000L;
+
+            // waiting for room in the queue is waiting for the wakeup
+            if (ppoll(waiting, 2, milliseconds > 0 ? &timeout : NULL,
+                      &previousMask) <= 0)
+            {
+                continue;
+            }
+
+            if (waiting[0].revents & POLLIN)
+            {
+                readEvents(&watch);
+            }
+
+            if (waiting[1].revents & POLLIN)
+            {
+                read(watch.wakeup, &wakeups, sizeof(wakeups));
+            }
+        }
+
+        // the files being scanned are finished, the waiting ones are dropped
+        poolDestroy(watch.pool);
+        summary->dropped += watch.pendingCount;
+        pthread_mutex_destroy(&watch.lock);
+    }
+
+    sigaction(SIGINT, &previousInterrupt, NULL);
+    sigaction(SIGTERM, &previousTerminate, NULL);
+    sigaction(SIGUSR1, &previousStatus, NULL);
+    pthread_sigmask(SIG_SETMASK, &previousMask, NULL);
+
+    freeWatch(&watch);
+
+    return watch.pool != NULL;
+}
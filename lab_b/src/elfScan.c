@@ -0,0 +1,258 @@
+/**
+ * the code of ELF files.
+ *
+ * the headers are read as myELF does, with both classes brought to a common
+ * form. every header and every region is checked against the size of the
+ * image, so a truncated or hostile file is rejected instead of read past.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include "../include/elfScan.h"
+
+// the fields of a section or program header that matter, in either class
+typedef struct elfEntry
+{
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t offset;
+    uint64_t size;
+} elfEntry;
+
+// the fields of the ELF header that matter
+typedef struct elfHeader
+{
+    bool wide;             // ELFCLASS64
+    uint64_t tableOffset;  // of the section headers, or the program headers
+    uint16_t entrySize;
+    uint16_t entryCount;
+    uint16_t namesIndex;   // the section of the section names
+    bool sections;
+} elfHeader;
+
+/**
+ * @brief check if a range lies inside the image.
+ */
+static bool inImage(uint64_t offset, uint64_t length, size_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+/**
+ * @brief read the ELF header, and choose the section headers if there are
+ * any and the program headers otherwise.
+ *
+ * @param image the file's content.
+ * @param size its size.
+ * @param header the header read.
+ * @return true if the image is an ELF file in the native byte order.
+ */
+static bool readHeader(const unsigned char *image, size_t size,
+                       elfHeader *header)
+{
+    const uint16_t one = 1;
+    int order = *(const unsigned char *)&one ? ELFDATA2LSB : ELFDATA2MSB;
+    Elf32_Ehdr narrow;
+    Elf64_Ehdr wide;
+
+    if (size < EI_NIDENT || memcmp(image, ELFMAG, SELFMAG) ||
+        image[EI_DATA] != order)
+    {
+        return false;
+    }
+
+    header->wide = image[EI_CLASS] == ELFCLASS64;
+
+    if (header->wide && size >= sizeof(Elf64_Ehdr))
+    {
+        memcpy(&wide, image, sizeof(Elf64_Ehdr));
+        header->sections = wide.e_shoff && wide.e_shnum;
+        header->tableOffset = header->sections ? wide.e_shoff : wide.e_phoff;
+        header->entrySize = header->sections ? wide.e_shentsize
+                                             : wide.e_phentsize;
+        header->entryCount = header->sections ? wide.e_shnum : wide.e_phnum;
+        header->namesIndex = wide.e_shstrndx;
+
+        return header->entrySize >= (header->sections ? sizeof(Elf64_Shdr)
+                                                      : sizeof(Elf64_Phdr));
+    }
+
+    if (image[EI_CLASS] == ELFCLASS32 && size >= sizeof(Elf32_Ehdr))
+    {
+        memcpy(&narrow, image, sizeof(Elf32_Ehdr));
+        header->sections = narrow.e_shoff && narrow.e_shnum;
+        header->tableOffset = header->sections ? narrow.e_shoff
+                                               : narrow.e_phoff;
+        header->entrySize = header->sections ? narrow.e_shentsize
+                                             : narrow.e_phentsize;
+        header->entryCount = header->sections ? narrow.e_shnum
+                                              : narrow.e_phnum;
+        header->namesIndex = narrow.e_shstrndx;
+
+        return header->entrySize >= (header->sections ? sizeof(Elf32_Shdr)
+                                                      : sizeof(Elf32_Phdr));
+    }
+
+    return false;
+}
+
+/**
+ * @brief read a section header, or a program header, in the common form. a
+ * program header's flags are its p_flags.
+ *
+ * @param image the file's content.
+ * @param header the ELF header.
+ * @param index the index of the entry.
+ * @param entry the entry read.
+ */
+static void readEntry(const unsigned char *image, const elfHeader *header,
+                      unsigned int index, elfEntry *entry)
+{
+    const unsigned char *at = image + header->tableOffset +
+                              (uint64_t)index * header->entrySize;
+    Elf32_Shdr section32;
+    Elf64_Shdr section64;
+    Elf32_Phdr program32;
+    Elf64_Phdr program64;
+
+    memset(entry, 0, sizeof(elfEntry));
+
+    if (header->sections && header->wide)
+    {
+        memcpy(&section64, at, sizeof(Elf64_Shdr));
+        entry->name = section64.sh_name;
+        entry->type = section64.sh_type;
+        entry->flags = section64.sh_flags;
+        entry->offset = section64.sh_offset;
+        entry->size = section64.sh_size;
+    }
+    else if (header->sections)
+    {
+        memcpy(&section32, at, sizeof(Elf32_Shdr));
+        entry->name = section32.sh_name;
+        entry->type = section32.sh_type;
+        entry->flags = section32.sh_flags;
+        entry->offset = section32.sh_offset;
+        entry->size = section32.sh_size;
+    }
+    else if (header->wide)
+    {
+        memcpy(&program64, at, sizeof(Elf64_Phdr));
+        entry->type = program64.p_type;
+        entry->flags = program64.p_flags;
+        entry->offset = program64.p_offset;
+        entry->size = program64.p_filesz;
+    }
+    else
+    {
+        memcpy(&program32, at, sizeof(Elf32_Phdr));
+        entry->type = program32.p_type;
+        entry->flags = program32.p_flags;
+        entry->offset = program32.p_offset;
+        entry->size = program32.p_filesz;
+    }
+}
+
+/**
+ * @brief check if an entry holds code that is stored in the file.
+ */
+static bool isCode(const elfHeader *header, const elfEntry *entry)
+{
+    if (header->sections)
+    {
+        return (entry->flags & SHF_EXECINSTR) && entry->type != SHT_NOBITS;
+    }
+
+    return entry->type == PT_LOAD && (entry->flags & PF_X);
+}
+
+/**
+ * @brief copy the name of a section from the section names, or make one up
+ * if it can't be found there or the entry is a segment.
+ *
+ * @param image the file's content.
+ * @param header the ELF header.
+ * @param names the section of the section names, or NULL.
+ * @param entry the entry.
+ * @param index the index of the entry.
+ * @param name the name, ELF_NAME_MAX bytes.
+ */
+static void copyName(const unsigned char *image, const elfHeader *header,
+                     const elfEntry *names, const elfEntry *entry,
+                     unsigned int index, char *name)
+{
+    const char *start;
+    size_t length;
+
+    if (names && entry->name < names->size)
+    {
+        start = (const char *)image + names->offset + entry->name;
+        length = strnlen(start, names->size - entry->name);
+
+        if (length > 0 && length < names->size - entry->name)
+        {
+            snprintf(name, ELF_NAME_MAX, "%.*s", (int)length, start);
+            return;
+        }
+    }
+
+    snprintf(name, ELF_NAME_MAX, "%s%u",
+             header->sections ? "section" : "segment", index);
+}
+
+int elfRegions(const unsigned char *image, size_t size, elfRegion **regions)
+{
+    elfHeader header;
+    elfEntry entry, names, *namesSection = NULL;
+    unsigned int i;
+    int count = 0;
+
+    *regions = NULL;
+
+    if (!readHeader(image, size, &header) ||
+        !inImage(header.tableOffset,
+                 (uint64_t)header.entryCount * header.entrySize, size))
+    {
+        return -1;
+    }
+
+    if (header.sections && header.namesIndex < header.entryCount)
+    {
+        readEntry(image, &header, header.namesIndex, &names);
+
+        if (inImage(names.offset, names.size, size))
+        {
+            namesSection = &names;
+        }
+    }
+
+    if (header.entryCount &&
+        !(*regions = (elfRegion *)calloc(header.entryCount, sizeof(elfRegion))))
+    {
+        return -1;
+    }
+
+    for (i = 0; i < header.entryCount; i++)
+    {
+        readEntry(image, &header, i, &entry);
+
+        if (!isCode(&header, &entry) || entry.size == 0 || entry.offset >= size)
+        {
+            continue;
+        }
+
+        // a region that doesn't fit in the file is cut at its end
+        (*regions)[count].offset = entry.offset;
+        (*regions)[count].size = inImage(entry.offset, entry.size, size)
+                                     ? entry.size
+                                     : size - entry.offset;
+        copyName(image, &header, namesSection, &entry, i,
+                 (*regions)[count].name);
+        count++;
+    }
+
+    return count;
+}
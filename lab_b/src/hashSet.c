@@ -0,0 +1,357 @@
+/**
+ * blocklists of SHA-256 digests.
+ *
+ * the digests are kept sorted in one array, so an entry costs its 32 bytes
+ * and nothing else. since digests are uniformly distributed, their first
+ * bits split them into buckets of about the same size: an index of where
+ * every bucket starts, sized for HASH_BUCKET_LOAD or more digests a bucket,
+ * adds at most a byte per entry and leaves a handful of digests to compare
+ * per lookup. a compiled blocklist is the sorted array itself, so loading it
+ * costs a mapping and a pass to build the index.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/hashSet.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+#define INITIAL_DIGESTS 1024
+
+static int compareDigests(const void *first, const void *second)
+{
+    return memcmp(first, second, SHA256_SIZE);
+}
+
+/**
+ * @brief the bucket of a digest, its first bucketBits bits.
+ */
+static uint32_t bucketOf(const hashSet *set, const unsigned char *digest)
+{
+    uint32_t prefix = (uint32_t)digest[0] << 24 | (uint32_t)digest[1] << 16 |
+                      (uint32_t)digest[2] << 8 | digest[3];
+
+    return set->bucketBits ? prefix >> (32 - set->bucketBits) : 0;
+}
+
+/**
+ * @brief build the index of the buckets of the sorted digests.
+ *
+ * @return true on success.
+ */
+static bool buildBuckets(hashSet *set)
+{
+    size_t bucketCount, i;
+    uint32_t bucket = 0;
+
+    set->bucketBits = 0;
+
+    while (set->bucketBits < 24 &&
+           ((size_t)HASH_BUCKET_LOAD << (set->bucketBits + 1)) <= set->count)
+    {
+        set->bucketBits++;
+    }
+
+    bucketCount = (size_t)1 << set->bucketBits;
+
+    if (!(set->buckets = (uint32_t *)malloc((bucketCount + 1) *
+                                            sizeof(uint32_t))))
+    {
+        return false;
+    }
+
+    // every bucket starts at its first digest, or where the next one does
+    for (i = 0; i < set->count; i++)
+    {
+        for (; bucket <= bucketOf(set, set->digests + i * SHA256_SIZE);
+             bucket++)
+        {
+            set->buckets[bucket] = i;
+        }
+    }
+
+    for (; bucket <= bucketCount; bucket++)
+    {
+        set->buckets[bucket] = set->count;
+    }
+
+    return true;
+}
+
+/**
+ * @brief parse the hex digest at the start of a line.
+ *
+ * @param line the line.
+ * @param digest the digest, set on success.
+ * @return true if the line starts with a whole digest.
+ */
+static bool parseDigest(const char *line, unsigned char *digest)
+{
+    int i, nibble;
+    char c;
+
+    for (i = 0; i < 2 * SHA256_SIZE; i++)
+    {
+        c = line[i];
+
+        if (c >= '0' && c <= '9')
+        {
+            nibble = c - '0';
+        }
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+        {
+            nibble = (c | 0x20) - 'a' + 10;
+        }
+        else
+        {
+            return false;
+        }
+
+        digest[i / 2] = i % 2 ? digest[i / 2] | nibble : nibble << 4;
+    }
+
+    // the digest is followed by a file name, or nothing
+    c = line[2 * SHA256_SIZE];
+
+    return c == '\0' || c == '\n' || c == '\r' || c == ' ' || c == '\t';
+}
+
+/**
+ * @brief read a text blocklist into owned digests, sorted and without
+ * duplicates. a line that isn't a digest is skipped, so a typo doesn't
+ * throw the rest of the list away.
+ *
+ * @param set the set.
+ * @param file the blocklist.
+ * @param path its path, for onBadLine.
+ * @param onBadLine called for every line skipped, or NULL.
+ * @param context passed to onBadLine.
+ * @return true on success.
+ */
+static bool readDigests(hashSet *set, FILE *file, const char *path,
+                        badLineHandler onBadLine, void *context)
+{
+    size_t capacity = 0, lineSize = 0, i, unique;
+    unsigned long number = 0;
+    unsigned char *grown;
+    char *line = NULL;
+    bool ok = true;
+
+    while (ok && getline(&line, &lineSize, file) != -1)
+    {
+        number++;
+
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[0] == '#')
+        {
+            continue;
+        }
+
+        if (set->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : INITIAL_DIGESTS;
+
+            if (!(grown = (unsigned char *)realloc(set->owned,
+                                                   capacity * SHA256_SIZE)))
+            {
+                ok = false;
+                break;
+            }
+
+            set->owned = grown;
+        }
+
+        if (parseDigest(line, set->owned + set->count * SHA256_SIZE))
+        {
+            set->count++;
+            continue;
+        }
+
+        set->skipped++;
+
+        if (onBadLine)
+        {
+            onBadLine(context, path, number);
+        }
+    }
+
+    free(line);
+
+    if (!ok || ferror(file))
+    {
+        return false;
+    }
+
+    if (!set->count)
+    {
+        return true;
+    }
+
+    qsort(set->owned, set->count, SHA256_SIZE, compareDigests);
+
+    for (i = unique = 0; i < set->count; i++)
+    {
+        if (!unique || memcmp(set->owned + (unique - 1) * SHA256_SIZE,
+                              set->owned + i * SHA256_SIZE, SHA256_SIZE))
+        {
+            memmove(set->owned + unique++ * SHA256_SIZE,
+                    set->owned + i * SHA256_SIZE, SHA256_SIZE);
+        }
+    }
+
+    set->count = unique;
+    set->digests = set->owned;
+
+    return true;
+}
+
+bool hashSetLoad(hashSet *set, const char *path, badLineHandler onBadLine,
+                 void *context)
+{
+    const hashHeader *header;
+    FILE *file;
+    bool ok;
+
+    memset(set, 0, sizeof(hashSet));
+
+    if (!mapFile(&set->file, path, false))
+    {
+        return false;
+    }
+
+    header = (const hashHeader *)set->file.data;
+
+    // the digests of a compiled blocklist are trusted, it is written by
+    // hashSetCompile
+    if (set->file.size >= sizeof(hashHeader) &&
+        !memcmp(header->magic, HASH_MAGIC, 4))
+    {
+        if (header->version != HASH_VERSION ||
+            (set->file.size - sizeof(hashHeader)) / SHA256_SIZE !=
+                header->count ||
+            (set->file.size - sizeof(hashHeader)) % SHA256_SIZE)
+        {
+            hashSetFree(set);
+            return false;
+        }
+
+        set->digests = set->file.data + sizeof(hashHeader);
+        set->count = header->count;
+    }
+    else
+    {
+        unmapFile(&set->file);
+
+        if (!(file = fopen(path, "r")))
+        {
+            return false;
+        }
+
+        ok = readDigests(set, file, path, onBadLine, context);
+        fclose(file);
+
+        if (!ok)
+        {
+            hashSetFree(set);
+            return false;
+        }
+    }
+
+    if (!buildBuckets(set))
+    {
+        hashSetFree(set);
+        return false;
+    }
+
+    return true;
+}
+
+bool hashSetContains(const hashSet *set,
+                     const unsigned char digest[SHA256_SIZE])
+{
+    uint32_t bucket, low, high, middle;
+    int order;
+
+    if (!set->count)
+    {
+        return false;
+    }
+
+    bucket = bucketOf(set, digest);
+    low = set->buckets[bucket];
+    high = set->buckets[bucket + 1];
+
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        order = memcmp(digest, set->digests + (size_t)middle * SHA256_SIZE,
+                       SHA256_SIZE);
+
+        if (!order)
+        {
+            return true;
+        }
+
+        if (order < 0)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+
+    return false;
+}
+
+bool hashSetCompile(const hashSet *set, const char *path)
+{
+    hashHeader header;
+    FILE *file;
+    bool ok;
+
+    if (!(file = fopen(path, "wb")))
+    {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(hashHeader));
+    memcpy(header.magic, HASH_MAGIC, 4);
+    header.version = HASH_VERSION;
+    header.count = set->count;
+
+    ok = fwrite(&header, sizeof(hashHeader), 1, file) == 1 &&
+         (!set->count ||
+          fwrite(set->digests, SHA256_SIZE, set->count, file) == set->count);
+
+    return fclose(file) == 0 && ok;
+}
+
+uint64_t hashSetDigest(const hashSet *set)
+{
+    uint64_t digest = FNV_OFFSET;
+    size_t i;
+
+    for (i = 0; i < set->count * SHA256_SIZE; i++)
+    {
+        digest = (digest ^ set->digests[i]) * FNV_PRIME;
+    }
+
+    return digest;
+}
+
+size_t hashSetMemory(const hashSet *set)
+{
+    return set->count * SHA256_SIZE +
+           (((size_t)1 << set->bucketBits) + 1) * sizeof(uint32_t);
+}
+
+void hashSetFree(hashSet *set)
+{
+    unmapFile(&set->file);
+    free(set->owned);
+    free(set->buckets);
+    memset(set, 0, sizeof(hashSet));
+}
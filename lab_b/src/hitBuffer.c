@@ -0,0 +1,75 @@
+/**
+ * a reusable array of hits.
+ */
+
+#include <stdlib.h>
+#include "../include/hitBuffer.h"
+
+#define INITIAL_HITS 16
+
+bool hitAppend(hitBuffer *buffer, unsigned int virusIndex,
+               unsigned long long offset)
+{
+    size_t capacity;
+    scanHit *grown;
+
+    if (buffer->count == buffer->capacity)
+    {
+        capacity = buffer->capacity ? buffer->capacity * 2 : INITIAL_HITS;
+
+        if (!(grown = (scanHit *)realloc(buffer->hits,
+                                         capacity * sizeof(scanHit))))
+        {
+            return false;
+        }
+
+        buffer->hits = grown;
+        buffer->capacity = capacity;
+    }
+
+    buffer->hits[buffer->count].offset = offset;
+    buffer->hits[buffer->count].virusIndex = virusIndex;
+    buffer->count++;
+
+    return true;
+}
+
+/**
+ * @brief order hits by offset, and hits in the same offset by the order
+ * of the viruses in the list.
+ */
+static int compareHits(const void *a, const void *b)
+{
+    const scanHit *first = (const scanHit *)a, *second = (const scanHit *)b;
+
+    if (first->offset != second->offset)
+    {
+        return first->offset < second->offset ? -1 : 1;
+    }
+
+    return (first->virusIndex > second->virusIndex) -
+           (first->virusIndex < second->virusIndex);
+}
+
+void hitSort(hitBuffer *buffer, size_t first)
+{
+    if (buffer->count > first + 1)
+    {
+        qsort(buffer->hits + first, buffer->count - first, sizeof(scanHit),
+              compareHits);
+    }
+}
+
+void hitClear(hitBuffer *buffer)
+{
+    buffer->count = 0;
+}
+
+void hitFree(hitBuffer *buffer)
+{
+    free(buffer->hits);
+
+    buffer->hits = NULL;
+    buffer->count = 0;
+    buffer->capacity = 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * whole-file memory mappings, so a file is scanned and fixed in place
+ * without being copied into user buffers.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>    // for open
+#include <unistd.h>   // for close
+#include <sys/mman.h> // for mmap, madvise and msync
+#include <sys/stat.h> // for fstat
+#include "../include/mappedFile.h"
+
+bool mapFile(mappedFile *file, const char *path, bool writable)
+{
+    struct stat info;
+    void *data;
+    int fd;
+
+    memset(file, 0, sizeof(mappedFile));
+
+    if ((fd = open(path, writable ? O_RDWR : O_RDONLY)) == -1)
+    {
+        return false;
+    }
+
+    // a 32-bit address space can't hold every file, and the size of a
+    // FIFO, a device or a procfs entry, 0, isn't the size of its contents
+    if (fstat(fd, &info) == -1 || (uintmax_t)info.st_size > SIZE_MAX ||
+        (!S_ISREG(info.st_mode) && !info.st_size))
+    {
+        close(fd);
+        return false;
+    }
+
+    file->size = info.st_size;
+    file->writable = writable;
+
+    // mapping an empty file fails, and there is nothing to scan anyway
+    if (file->size > 0)
+    {
+        data = mmap(NULL, file->size,
+                    writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                    writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+
+        // the scan reads the mapping once, from start to end
+        madvise(data, file->size, MADV_SEQUENTIAL);
+        madvise(data, file->size, MADV_WILLNEED);
+
+        file->data = (unsigned char *)data;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+
+    return true;
+}
+
+bool syncFile(mappedFile *file)
+{
+    if (!file->data || !file->writable)
+    {
+        return true;
+    }
+
+    return msync(file->data, file->size, MS_SYNC) == 0;
+}
+
+void unmapFile(mappedFile *file)
+{
+    if (file->data)
+    {
+        munmap(file->data, file->size);
+    }
+
+    memset(file, 0, sizeof(mappedFile));
+}
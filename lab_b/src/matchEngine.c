@@ -0,0 +1,364 @@
+/**
+ * the engines a matcher scans with, other than the automaton, and the
+ * choice between them.
+ *
+ * every engine looks for the keys of the viruses, the anchor of a pattern
+ * and the signature of any other virus, and checks a pattern where its
+ * anchor is found, so they all find the same hits.
+ *
+ * the shift engine is Wu-Manber's: a window as long as the shortest key
+ * slides over the buffer, and its last two bytes, a block, index a table of
+ * how far the window may jump before its end can be the end of a key's
+ * window. only windows ending in a block that ends some key's window are
+ * compared with the keys, so with long keys most of the buffer is jumped
+ * over, and even with many short ones the tables stay far smaller than an
+ * automaton of the keys.
+ *
+ * the automaton still wins when its prefilter compares the first bytes of
+ * the keys directly: the few offsets that start one are all it looks at.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "../include/matchEngine.h"
+#include "../include/sigPattern.h"
+#include "../include/prefilter.h"
+
+static const char *engineNames[] = {"automaton", "shift", "naive", "auto"};
+
+static matchEngine selected = ENGINE_AUTO;
+
+void keyStatsCollect(keyStats *stats, const sigArena *arena)
+{
+    unsigned short length, offset, span;
+    unsigned int i;
+    virus *vir;
+
+    memset(stats, 0, sizeof(keyStats));
+
+    for (i = 0; i < ARENA_ALPHABET; i++)
+    {
+        stats->firstBytes += arena->bucketStart[i] < arena->bucketStart[i + 1];
+    }
+
+    for (i = 0; i < arena->count; i++)
+    {
+        vir = arenaVirus(arena, i);
+        virusKey(vir, &length, &offset);
+
+        if (length == 0)
+        {
+            continue;
+        }
+
+        // the windows of a stream must hold the longest match of a pattern
+        span = vir->SigSize & SIG_PATTERN ? virusPattern(vir)->maxSpan
+                                          : vir->SigSize;
+
+        stats->shortest = stats->keys && stats->shortest < length
+                              ? stats->shortest
+                              : length;
+        stats->longest = stats->longest > length ? stats->longest : length;
+        stats->maxLength = stats->maxLength > span ? stats->maxLength : span;
+        stats->keyBytes += length;
+        stats->keys++;
+    }
+}
+
+matchEngine engineChoose(const keyStats *stats)
+{
+    if (stats->shortest < SHIFT_MIN_KEY || stats->keys >= SHIFT_MAX_KEYS)
+    {
+        return ENGINE_AUTOMATON;
+    }
+
+    // the prefilter skips to the offsets that start a key faster than the
+    // shift engine jumps
+    if (prefilterCurrent() != PREFILTER_OFF &&
+        stats->firstBytes <= PREFILTER_MAX_BYTES)
+    {
+        return ENGINE_AUTOMATON;
+    }
+
+    return ENGINE_SHIFT;
+}
+
+bool engineSelect(matchEngine engine)
+{
+    if (engine > ENGINE_AUTO)
+    {
+        return false;
+    }
+
+    selected = engine;
+
+    return true;
+}
+
+matchEngine engineCurrent()
+{
+    return selected;
+}
+
+const char *engineName(matchEngine engine)
+{
+    return engine <= ENGINE_AUTO ? engineNames[engine] : "unknown";
+}
+
+/**
+ * @brief the block ending at a position of a buffer.
+ *
+ * @param bytes the first byte of the block.
+ * @param blockBytes the size of a block.
+ */
+static inline unsigned int blockAt(const unsigned char *bytes,
+                                   unsigned short blockBytes)
+{
+    return blockBytes == 2 ? (unsigned int)bytes[0] << 8 | bytes[1]
+                           : bytes[0];
+}
+
+shiftTables *shiftBuild(const sigArena *arena, const keyStats *stats)
+{
+    shiftTables *tables = (shiftTables *)calloc(1, sizeof(shiftTables));
+    unsigned short length, offset, m, blockBytes, distance;
+    const unsigned char *key;
+    unsigned int i, block, q;
+
+    if (!tables)
+    {
+        return NULL;
+    }
+
+    m = stats->shortest;
+    blockBytes = m >= 2 ? 2 : 1;
+    tables->windowLength = m;
+    tables->blockBytes = blockBytes;
+    tables->shift = (uint16_t *)malloc(SHIFT_TABLE_SIZE * sizeof(uint16_t));
+    tables->bucketStart = (uint32_t *)calloc(SHIFT_TABLE_SIZE + 1,
+                                             sizeof(uint32_t));
+    tables->candidates = (uint32_t *)malloc((stats->keys + 1) *
+                                            sizeof(uint32_t));
+
+    if (!tables->shift || !tables->bucketStart || !tables->candidates)
+    {
+        shiftFree(tables);
+        return NULL;
+    }
+
+    // a block in no key's window lets the window jump past it
+    for (block = 0; block < SHIFT_TABLE_SIZE; block++)
+    {
+        tables->shift[block] = m > 0 ? m - blockBytes + 1 : 1;
+    }
+
+    for (i = 0; i < arena->count; i++)
+    {
+        key = virusKey(arenaVirus(arena, i), &length, &offset);
+
+        if (length == 0)
+        {
+            continue;
+        }
+
+        // q is the last byte of a block in the key's window
+        for (q = blockBytes - 1; q < m; q++)
+        {
+            block = blockAt(key + q + 1 - blockBytes, blockBytes);
+            distance = m - 1 - q;
+
+            if (distance < tables->shift[block])
+            {
+                tables->shift[block] = distance;
+            }
+        }
+
+        tables->bucketStart[blockAt(key + m - blockBytes, blockBytes) + 1]++;
+    }
+
+    for (block = 0; block < SHIFT_TABLE_SIZE; block++)
+    {
+        tables->bucketStart[block + 1] += tables->bucketStart[block];
+    }
+
+    // bucketStart[block] is the next free slot of the block, until the end
+    for (i = 0; i < arena->count; i++)
+    {
+        key = virusKey(arenaVirus(arena, i), &length, &offset);
+
+        if (length > 0)
+        {
+            block = blockAt(key + m - blockBytes, blockBytes);
+            tables->candidates[tables->bucketStart[block]++] = i;
+        }
+    }
+
+    for (block = SHIFT_TABLE_SIZE; block > 0; block--)
+    {
+        tables->bucketStart[block] = tables->bucketStart[block - 1];
+    }
+
+    tables->bucketStart[0] = 0;
+
+    return tables;
+}
+
+void shiftFree(shiftTables *tables)
+{
+    if (tables)
+    {
+        free(tables->shift);
+        free(tables->bucketStart);
+        free(tables->candidates);
+        free(tables);
+    }
+}
+
+size_t shiftMemory(const shiftTables *tables)
+{
+    return sizeof(shiftTables) + SHIFT_TABLE_SIZE * sizeof(uint16_t) +
+           (SHIFT_TABLE_SIZE + 1) * sizeof(uint32_t) +
+           tables->bucketStart[SHIFT_TABLE_SIZE] * sizeof(uint32_t);
+}
+
+/**
+ * @brief compare the key of a virus with the buffer, and append the hit of
+ * the virus if it is there.
+ *
+ * @param arena the viruses.
+ * @param index the virus.
+ * @param buffer the scanned buffer.
+ * @param size its size.
+ * @param position where the key would start.
+ * @param hits receives the hit.
+ * @param undecided receives the hit of a pattern too costly to check here.
+ * @param stats counts the check, unless NULL.
+ * @return false if the hits couldn't grow.
+ */
+static bool checkKey(const sigArena *arena, unsigned int index,
+                     const unsigned char *buffer, size_t size,
+                     size_t position, hitBuffer *hits, hitBuffer *undecided,
+                     scanStats *stats)
+{
+    const virus *vir = arenaVirus(arena, index);
+    unsigned short length, offset;
+    const unsigned char *key = virusKey(vir, &length, &offset);
+    patternResult result = PATTERN_MATCH;
+    size_t start;
+
+    statsAttempt(stats, index);
+
+    // the first byte of a pattern may be in a previous window
+    if (length > size - position || position < offset ||
+        memcmp(buffer + position, key, length))
+    {
+        return true;
+    }
+
+    start = position - offset;
+
+    if ((vir->SigSize & SIG_PATTERN) &&
+        (result = patternMatch(virusPattern(vir), buffer + start,
+                               size - start)) == PATTERN_MISMATCH)
+    {
+        return true;
+    }
+
+    return hitAppend(result == PATTERN_UNDECIDED ? undecided : hits, index,
+                     start);
+}
+
+size_t engineFinish(const sigArena *arena, const unsigned char *buffer,
+                    size_t size, hitBuffer *undecided, hitBuffer *hits,
+                    size_t first)
+{
+    bool ok = patternResolve(arena, buffer, size, undecided, hits);
+
+    hitFree(undecided);
+
+    if (!ok)
+    {
+        hits->count = first;
+        return 0;
+    }
+
+    hitSort(hits, first);
+
+    return hits->count - first;
+}
+
+size_t shiftScan(const shiftTables *tables, const sigArena *arena,
+                 const unsigned char *buffer, size_t size, hitBuffer *hits,
+                 scanStats *stats)
+{
+    size_t first = hits->count, end, start;
+    unsigned short m = tables->windowLength, blockBytes = tables->blockBytes;
+    hitBuffer undecided = {0};
+    unsigned int block;
+    uint32_t i;
+
+    // end is the last byte of the window
+    for (end = m - 1; m > 0 && end < size;)
+    {
+        block = blockAt(buffer + end + 1 - blockBytes, blockBytes);
+
+        if (tables->shift[block])
+        {
+            end += tables->shift[block];
+            continue;
+        }
+
+        start = end + 1 - m;
+
+        for (i = tables->bucketStart[block]; i < tables->bucketStart[block + 1];
+             i++)
+        {
+            if (!checkKey(arena, tables->candidates[i], buffer, size, start,
+                          hits, &undecided, stats))
+            {
+                hitFree(&undecided);
+                hits->count = first;
+                return 0;
+            }
+        }
+
+        end++;
+    }
+
+    return engineFinish(arena, buffer, size, &undecided, hits, first);
+}
+
+size_t naiveScan(const sigArena *arena, const unsigned char *buffer,
+                 size_t size, hitBuffer *hits, scanStats *stats)
+{
+    size_t first = hits->count, i;
+    unsigned short length, offset;
+    hitBuffer undecided = {0};
+    uint32_t j;
+
+    for (i = 0; i < size; i++)
+    {
+        // the keys of a byte are sorted by size, the rest don't fit either
+        for (j = arena->bucketStart[buffer[i]];
+             j < arena->bucketStart[buffer[i] + 1]; j++)
+        {
+            virusKey(arenaVirus(arena, arena->byFirstByte[j]), &length,
+                     &offset);
+
+            if (length > size - i)
+            {
+                break;
+            }
+
+            if (!checkKey(arena, arena->byFirstByte[j], buffer, size, i, hits,
+                          &undecided, stats))
+            {
+                hitFree(&undecided);
+                hits->count = first;
+                return 0;
+            }
+        }
+    }
+
+    return engineFinish(arena, buffer, size, &undecided, hits, first);
+}
@@ -0,0 +1,295 @@
+/**
+ * a prefilter for the first bytes of the signatures.
+ *
+ * while the automaton is in its root state, no signature is partially
+ * matched, so every offset that can't start a signature can be skipped. the
+ * SIMD implementations compare 16 or 32 bytes at a time against the set of
+ * first bytes, and only the offsets whose first two bytes begin a signature
+ * are handed back to the automaton. a pattern starts with its anchor here,
+ * the only part of it the automaton matches.
+ */
+
+#include <string.h>
+#include <immintrin.h>
+#include "../include/prefilter.h"
+#include "../include/sigPattern.h"
+
+#define SET_BIT(TABLE, INDEX) ((TABLE)[(INDEX) >> 3] |= 1 << ((INDEX) & 7))
+#define HAS_BIT(TABLE, INDEX) ((TABLE)[(INDEX) >> 3] & (1 << ((INDEX) & 7)))
+
+typedef size_t (*findFunction)(const acPrefilter *, const unsigned char *,
+                               size_t, size_t);
+
+static size_t findScalar(const acPrefilter *, const unsigned char *, size_t,
+                         size_t);
+
+static findFunction findCandidate = findScalar;
+static prefilterLevel selected = PREFILTER_SCALAR;
+
+void prefilterBuild(acPrefilter *prefilter, const sigArena *arena)
+{
+    unsigned int byte, j, distinct = 0;
+    unsigned short length, offset;
+    const unsigned char *key;
+
+    memset(prefilter, 0, sizeof(acPrefilter));
+
+    // the index groups the viruses by their first byte
+    for (byte = 0; byte < ARENA_ALPHABET; byte++)
+    {
+        if (arena->bucketStart[byte] == arena->bucketStart[byte + 1])
+        {
+            continue;
+        }
+
+        SET_BIT(prefilter->first, byte);
+        prefilter->lowNibble[byte & 15] |= 1 << ((byte >> 4) & 7);
+        prefilter->highNibble[byte >> 4] = 1 << ((byte >> 4) & 7);
+
+        if (distinct < PREFILTER_MAX_BYTES)
+        {
+            prefilter->distinct[distinct] = byte;
+        }
+
+        distinct++;
+
+        for (j = arena->bucketStart[byte]; j < arena->bucketStart[byte + 1];
+             j++)
+        {
+            key = virusKey(arenaVirus(arena, arena->byFirstByte[j]), &length,
+                           &offset);
+
+            if (length == 1)
+            {
+                SET_BIT(prefilter->single, byte);
+            }
+            else
+            {
+                SET_BIT(prefilter->pairs, byte << 8 | key[1]);
+            }
+        }
+    }
+
+    prefilter->distinctCount = distinct;
+    prefilter->enabled = distinct <= PREFILTER_DENSE;
+}
+
+/**
+ * @brief check if a signature may start at an offset whose byte is a first
+ * byte.
+ *
+ * @param prefilter a prefilter.
+ * @param buffer a buffer.
+ * @param position an offset in the buffer.
+ * @param size the size of the buffer.
+ * @return true if the offset's first two bytes begin a signature.
+ */
+static inline bool isCandidate(const acPrefilter *prefilter,
+                               const unsigned char *buffer, size_t position,
+                               size_t size)
+{
+    return HAS_BIT(prefilter->single, buffer[position]) ||
+           (position + 1 < size &&
+            HAS_BIT(prefilter->pairs,
+                    buffer[position] << 8 | buffer[position + 1]));
+}
+
+static size_t findScalar(const acPrefilter *prefilter,
+                         const unsigned char *buffer, size_t from, size_t size)
+{
+    for (; from < size; from++)
+    {
+        if (HAS_BIT(prefilter->first, buffer[from]) &&
+            isCandidate(prefilter, buffer, from, size))
+        {
+            return from;
+        }
+    }
+
+    return size;
+}
+
+/**
+ * @brief check the offsets of a block marked in a bit mask.
+ *
+ * @param prefilter a prefilter.
+ * @param buffer a buffer.
+ * @param from the offset of the block.
+ * @param mask a bit for every offset in the block holding a first byte.
+ * @param size the size of the buffer.
+ * @return size_t the first candidate, or size if there is none.
+ */
+static inline size_t checkMask(const acPrefilter *prefilter,
+                               const unsigned char *buffer, size_t from,
+                               unsigned int mask, size_t size)
+{
+    size_t position;
+
+    while (mask)
+    {
+        position = from + __builtin_ctz(mask);
+
+        if (isCandidate(prefilter, buffer, position, size))
+        {
+            return position;
+        }
+
+        mask &= mask - 1;
+    }
+
+    return size;
+}
+
+__attribute__((target("sse2"))) static size_t
+findSse2(const acPrefilter *prefilter, const unsigned char *buffer,
+         size_t from, size_t size)
+{
+    __m128i needles[PREFILTER_MAX_BYTES], block, matches;
+    unsigned int i, count = prefilter->distinctCount;
+    size_t found;
+
+    // without a byte shuffle, only a few bytes can be compared directly
+    if (count > PREFILTER_MAX_BYTES)
+    {
+        return findScalar(prefilter, buffer, from, size);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        needles[i] = _mm_set1_epi8((char)prefilter->distinct[i]);
+    }
+
+    for (; from + 16 <= size; from += 16)
+    {
+        block = _mm_loadu_si128((const __m128i *)(buffer + from));
+        matches = _mm_setzero_si128();
+
+        for (i = 0; i < count; i++)
+        {
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, needles[i]));
+        }
+
+        found = checkMask(prefilter, buffer, from,
+                          _mm_movemask_epi8(matches), size);
+
+        if (found != size)
+        {
+            return found;
+        }
+    }
+
+    return findScalar(prefilter, buffer, from, size);
+}
+
+__attribute__((target("avx2"))) static size_t
+findAvx2(const acPrefilter *prefilter, const unsigned char *buffer,
+         size_t from, size_t size)
+{
+    __m256i needles[PREFILTER_MAX_BYTES], block, matches, low, high;
+    __m256i lowTable, highTable, nibbles = _mm256_set1_epi8(0x0f);
+    unsigned int i, count = prefilter->distinctCount;
+    bool direct = count <= PREFILTER_MAX_BYTES;
+    size_t found;
+
+    for (i = 0; direct && i < count; i++)
+    {
+        needles[i] = _mm256_set1_epi8((char)prefilter->distinct[i]);
+    }
+
+    // a byte is in a bucket of both of its nibbles. the buckets only
+    // confuse bytes 0x80 apart, and those are told apart by isCandidate
+    lowTable = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)prefilter->lowNibble));
+    highTable = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)prefilter->highNibble));
+
+    for (; from + 32 <= size; from += 32)
+    {
+        block = _mm256_loadu_si256((const __m256i *)(buffer + from));
+
+        if (direct)
+        {
+            matches = _mm256_setzero_si256();
+
+            for (i = 0; i < count; i++)
+            {
+                matches = _mm256_or_si256(matches,
+                                          _mm256_cmpeq_epi8(block, needles[i]));
+            }
+        }
+        else
+        {
+            low = _mm256_shuffle_epi8(lowTable,
+                                      _mm256_and_si256(block, nibbles));
+            high = _mm256_shuffle_epi8(
+                highTable,
+                _mm256_and_si256(_mm256_srli_epi16(block, 4), nibbles));
+            matches = _mm256_cmpeq_epi8(_mm256_and_si256(low, high),
+                                        _mm256_setzero_si256());
+            matches = _mm256_xor_si256(matches, _mm256_set1_epi8(-1));
+        }
+
+        found = checkMask(prefilter, buffer, from,
+                          _mm256_movemask_epi8(matches), size);
+
+        if (found != size)
+        {
+            return found;
+        }
+    }
+
+    return findScalar(prefilter, buffer, from, size);
+}
+
+bool prefilterSelect(prefilterLevel level)
+{
+    __builtin_cpu_init();
+
+    if (level == PREFILTER_BEST)
+    {
+        level = __builtin_cpu_supports("avx2")   ? PREFILTER_AVX2
+                : __builtin_cpu_supports("sse2") ? PREFILTER_SSE2
+                                                 : PREFILTER_SCALAR;
+    }
+
+    switch (level)
+    {
+    case PREFILTER_OFF:
+    case PREFILTER_SCALAR:
+        findCandidate = findScalar;
+        break;
+    case PREFILTER_SSE2:
+        if (!__builtin_cpu_supports("sse2"))
+        {
+            return false;
+        }
+
+        findCandidate = findSse2;
+        break;
+    case PREFILTER_AVX2:
+        if (!__builtin_cpu_supports("avx2"))
+        {
+            return false;
+        }
+
+        findCandidate = findAvx2;
+        break;
+    default:
+        return false;
+    }
+
+    selected = level;
+
+    return true;
+}
+
+prefilterLevel prefilterCurrent()
+{
+    return selected;
+}
+
+size_t prefilterFind(const acPrefilter *prefilter,
+                     const unsigned char *buffer, size_t from, size_t size)
+{
+    return findCandidate(prefilter, buffer, from, size);
+}
@@ -0,0 +1,298 @@
+/**
+ * a scan that overlaps reading with scanning.
+ *
+ * a reader thread fills the slots of a ring in order while the calling
+ * thread feeds the filled ones to a stream, so the latency of the disk is
+ * hidden behind the scan of the chunks already read. each side only waits
+ * when the ring is full or empty, and the time it waits is measured. the
+ * reader of a regular file skips its holes, and tells the scanner how many
+ * zeros come before the data of every slot.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h> // for fstat
+#include "../include/readPipeline.h"
+
+typedef struct ringSlot
+{
+    unsigned char *data;
+    size_t size;
+    unsigned long long hole; // zeros skipped before the data
+    bool last;            // the end of the file, or a failed read
+    bool failed;          // the read of this slot failed
+} ringSlot;
+
+typedef struct readPipeline
+{
+    int fd;
+    ringSlot *slots;
+    int depth;
+    size_t chunkSize;
+    bool seekable;            // a regular file, read by extents
+    bool sparse;              // the file system reports holes
+    off_t position, dataEnd, end;
+    pthread_mutex_t lock;
+    pthread_cond_t notFull;   // signaled when a slot is released
+    pthread_cond_t notEmpty;  // signaled when a slot is filled
+    int head, count;          // guarded by lock
+    pipelineStats *stats;
+} readPipeline;
+
+/**
+ * @brief the current time in seconds.
+ */
+static double now()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief fill a slot with the next chunk of the file. a slot of a regular
+ * file ends with its data extent, and the hole after the extent is skipped
+ * by the next slot.
+ *
+ * @param pipeline a pipeline.
+ * @param slot a free slot.
+ */
+static void fillSlot(readPipeline *pipeline, ringSlot *slot)
+{
+    size_t wanted = pipeline->chunkSize;
+    ssize_t bytesRead;
+    off_t data;
+
+    slot->size = 0;
+    slot->hole = 0;
+    slot->failed = false;
+
+    if (pipeline->seekable && pipeline->position == pipeline->dataEnd)
+    {
+        streamExtent(pipeline->fd, pipeline->position, pipeline->end,
+                     &pipeline->sparse, &data, &pipeline->dataEnd);
+        slot->hole = data - pipeline->position;
+        pipeline->position = data;
+    }
+
+    if (pipeline->seekable &&
+        (off_t)wanted > pipeline->dataEnd - pipeline->position)
+    {
+        wanted = pipeline->dataEnd - pipeline->position;
+    }
+
+    // short reads are completed, so only the last slot of an extent is
+    // partial
+    while (slot->size < wanted)
+    {
+        bytesRead = pipeline->seekable
+                        ? pread(pipeline->fd, slot->data + slot->size,
+                                wanted - slot->size, pipeline->position)
+                        : read(pipeline->fd, slot->data + slot->size,
+                               wanted - slot->size);
+
+        if (bytesRead > 0)
+        {
+            slot->size += bytesRead;
+            pipeline->position += bytesRead;
+        }
+        else if (bytesRead == 0 || errno != EINTR)
+        {
+            slot->failed = bytesRead == -1;
+            break;
+        }
+    }
+
+    slot->last = slot->failed || slot->size < wanted ||
+                 (pipeline->seekable ? pipeline->position >= pipeline->end
+                                     : slot->size == 0);
+}
+
+/**
+ * @brief the reader thread: fill slots until the end of the file.
+ *
+ * @param argument a pipeline.
+ * @return void* NULL.
+ */
+static void *readSlots(void *argument)
+{
+    readPipeline *pipeline = (readPipeline *)argument;
+    ringSlot *slot;
+    bool last = false;
+    double start;
+    int tail = 0;
+
+    while (!last)
+    {
+        pthread_mutex_lock(&pipeline->lock);
+
+        if (pipeline->count == pipeline->depth)
+        {
+            pipeline->stats->readerStalls++;
+            start = now();
+
+            while (pipeline->count == pipeline->depth)
+            {
+                pthread_cond_wait(&pipeline->notFull, &pipeline->lock);
+            }
+
+            pipeline->stats->readerSeconds += now() - start;
+        }
+
+        pthread_mutex_unlock(&pipeline->lock);
+
+        // the slot at the tail is not seen by the scanner until published
+        slot = &pipeline->slots[tail];
+        fillSlot(pipeline, slot);
+        last = slot->last;
+        tail = (tail + 1) % pipeline->depth;
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->count++;
+        pthread_cond_signal(&pipeline->notEmpty);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief release the memory of a pipeline's slots.
+ *
+ * @param pipeline a pipeline.
+ */
+static void freeSlots(readPipeline *pipeline)
+{
+    int i;
+
+    for (i = 0; i < pipeline->depth; i++)
+    {
+        free(pipeline->slots[i].data);
+    }
+
+    free(pipeline->slots);
+}
+
+bool pipelineScanFd(int fd, const acAutomaton *matcher, int depth,
+                    size_t chunkSize, hitHandler onHit, void *context,
+                    pipelineStats *stats)
+{
+    readPipeline pipeline;
+    scanStream stream;
+    struct stat info;
+    pthread_t reader;
+    ringSlot *slot;
+    bool last = false, failed = false;
+    double start;
+    int i;
+
+    memset(&pipeline, 0, sizeof(readPipeline));
+    memset(stats, 0, sizeof(pipelineStats));
+
+    pipeline.fd = fd;
+    pipeline.depth = depth;
+    pipeline.chunkSize = chunkSize;
+    pipeline.stats = stats;
+
+    // only a regular file has holes, anything else is read as a stream
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+        (pipeline.position = lseek(fd, 0, SEEK_CUR)) != -1)
+    {
+        pipeline.seekable = true;
+        pipeline.sparse = true;
+        pipeline.dataEnd = pipeline.position;
+        pipeline.end = info.st_size;
+    }
+
+    if (!(pipeline.slots = (ringSlot *)calloc(depth, sizeof(ringSlot))))
+    {
+        return false;
+    }
+
+    for (i = 0; i < depth; i++)
+    {
+        if (!(pipeline.slots[i].data = (unsigned char *)malloc(chunkSize)))
+        {
+            freeSlots(&pipeline);
+            return false;
+        }
+    }
+
+    if (!streamInit(&stream, matcher, chunkSize, onHit, context))
+    {
+        freeSlots(&pipeline);
+        return false;
+    }
+
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.notFull, NULL);
+    pthread_cond_init(&pipeline.notEmpty, NULL);
+
+    // the scanner drains the ring up to the last slot, so the reader never
+    // has to be stopped
+    if (pthread_create(&reader, NULL, readSlots, &pipeline) != 0)
+    {
+        pthread_mutex_destroy(&pipeline.lock);
+        pthread_cond_destroy(&pipeline.notFull);
+        pthread_cond_destroy(&pipeline.notEmpty);
+        streamFree(&stream);
+        freeSlots(&pipeline);
+
+        // without a reader, the file is read by the scanning thread
+        return streamScanFd(fd, matcher, onHit, context);
+    }
+
+    while (!last)
+    {
+        pthread_mutex_lock(&pipeline.lock);
+
+        if (pipeline.count == 0)
+        {
+            stats->scannerStalls++;
+            start = now();
+
+            while (pipeline.count == 0)
+            {
+                pthread_cond_wait(&pipeline.notEmpty, &pipeline.lock);
+            }
+
+            stats->scannerSeconds += now() - start;
+        }
+
+        pthread_mutex_unlock(&pipeline.lock);
+
+        // the slot at the head belongs to the scanner until released
+        slot = &pipeline.slots[pipeline.head];
+        streamSkip(&stream, slot->hole);
+        streamFeed(&stream, slot->data, slot->size);
+        stats->chunks += slot->size > 0;
+        stats->bytes += slot->size;
+        stats->holeBytes += slot->hole;
+        last = slot->last;
+        failed = slot->failed;
+
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.head = (pipeline.head + 1) % depth;
+        pipeline.count--;
+        pthread_cond_signal(&pipeline.notFull);
+        pthread_mutex_unlock(&pipeline.lock);
+    }
+
+    streamFinish(&stream);
+    pthread_join(reader, NULL);
+
+    pthread_mutex_destroy(&pipeline.lock);
+    pthread_cond_destroy(&pipeline.notFull);
+    pthread_cond_destroy(&pipeline.notEmpty);
+
+    streamFree(&stream);
+    freeSlots(&pipeline);
+
+    return !failed;
+}
@@ -0,0 +1,447 @@
+/**
+ * the results of the scans in text, JSON Lines or CSV.
+ *
+ * records are formatted by hand into a buffer rather than by printf, whose
+ * format parsing costs more than the scan on files with many hits, and the
+ * buffer is written out with a single fwrite once it is half full, between
+ * two files, so the records of a file are never interleaved with anything.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "../include/reportWriter.h"
+
+#define HEX_ROW(high)                                                         \
+    high "0" high "1" high "2" high "3" high "4" high "5" high "6" high "7"   \
+    high "8" high "9" high "a" high "b" high "c" high "d" high "e" high "f"
+
+// the two hex digits of every byte, at twice its value
+static const char hexPairs[] =
+    HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3") HEX_ROW("4")
+    HEX_ROW("5") HEX_ROW("6") HEX_ROW("7") HEX_ROW("8") HEX_ROW("9")
+    HEX_ROW("a") HEX_ROW("b") HEX_ROW("c") HEX_ROW("d") HEX_ROW("e")
+    HEX_ROW("f");
+
+static const char *formatNames[] = {"text", "jsonl", "csv"};
+
+/**
+ * @brief write the buffer out and empty it.
+ *
+ * @param writer the writer.
+ */
+static void writeBuffer(reportWriter *writer)
+{
+    if (writer->used &&
+        fwrite(writer->buffer, 1, writer->used, writer->out) != writer->used)
+    {
+        writer->failed = true;
+    }
+
+    writer->used = 0;
+}
+
+/**
+ * @brief append bytes to the buffer, writing it out whenever it fills up.
+ *
+ * @param writer the writer.
+ * @param data the bytes.
+ * @param length how many.
+ */
+static void put(reportWriter *writer, const char *data, size_t length)
+{
+    size_t part;
+
+    while (length)
+    {
+        if (writer->used == REPORT_BUFFER)
+        {
+            writeBuffer(writer);
+        }
+
+        part = REPORT_BUFFER - writer->used;
+        part = part < length ? part : length;
+        memcpy(writer->buffer + writer->used, data, part);
+        writer->used += part;
+        data += part;
+        length -= part;
+    }
+}
+
+static void putChar(reportWriter *writer, char c)
+{
+    if (writer->used == REPORT_BUFFER)
+    {
+        writeBuffer(writer);
+    }
+
+    writer->buffer[writer->used++] = c;
+}
+
+static void putString(reportWriter *writer, const char *text)
+{
+    put(writer, text, strlen(text));
+}
+
+static void putDecimal(reportWriter *writer, unsigned long long value)
+{
+    char digits[20];
+    int i = sizeof(digits);
+
+    do
+    {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    put(writer, digits + i, sizeof(digits) - i);
+}
+
+/**
+ * @brief append "0x" and a value in lowercase hex, of 4 digits at least.
+ *
+ * @param writer the writer.
+ * @param value the value.
+ */
+static void putOffset(reportWriter *writer, unsigned long long value)
+{
+    char digits[16];
+    int i = sizeof(digits);
+
+    while (value || i > (int)sizeof(digits) - 4)
+    {
+        i -= 2;
+        memcpy(digits + i, hexPairs + 2 * (value & 0xff), 2);
+        value >>= 8;
+    }
+
+    // an odd number of digits, beyond the first 4, starts with a 0
+    if (digits[i] == '0' && i < (int)sizeof(digits) - 4)
+    {
+        i++;
+    }
+
+    put(writer, "0x", 2);
+    put(writer, digits + i, sizeof(digits) - i);
+}
+
+/**
+ * @brief append a JSON string: quoted, with quotes, backslashes and control
+ * characters escaped. other bytes are copied as they are.
+ *
+ * @param writer the writer.
+ * @param text the string, or NULL for an empty one.
+ */
+static void putJson(reportWriter *writer, const char *text)
+{
+    const char *start;
+    unsigned char c;
+
+    putChar(writer, '"');
+
+    for (start = text; text && (c = *text); text++)
+    {
+        if (c == '"' || c == '\\' || c < 0x20)
+        {
+            put(writer, start, text - start);
+            put(writer, c < 0x20 ? "\\u00" : "\\", c < 0x20 ? 4 : 1);
+            put(writer, c < 0x20 ? hexPairs + 2 * c : (const char *)text,
+                c < 0x20 ? 2 : 1);
+            start = text + 1;
+        }
+    }
+
+    if (text)
+    {
+        put(writer, start, text - start);
+    }
+
+    putChar(writer, '"');
+}
+
+/**
+ * @brief append a CSV field, quoted with its quotes doubled if it holds a
+ * separator, a quote or a line break.
+ *
+ * @param writer the writer.
+ * @param text the field, or NULL for an empty one.
+ */
+static void putCsv(reportWriter *writer, const char *text)
+{
+    const char *quote;
+
+    if (!text)
+    {
+        return;
+    }
+
+    if (!text[strcspn(text, ",\"\r\n")])
+    {
+        putString(writer, text);
+        return;
+    }
+
+    putChar(writer, '"');
+
+    while ((quote = strchr(text, '"')))
+    {
+        put(writer, text, quote - text + 1);
+        putChar(writer, '"');
+        text = quote + 1;
+    }
+
+    putString(writer, text);
+    putChar(writer, '"');
+}
+
+/**
+ * @brief append the start of a record of the current file: its path and
+ * event, and in CSV the fields before the ones given.
+ *
+ * @param writer the writer.
+ * @param event the event.
+ */
+static void startRecord(reportWriter *writer, const char *event)
+{
+    if (writer->format == REPORT_JSONL)
+    {
+        putString(writer, "{\"path\":");
+        putJson(writer, writer->path);
+        putString(writer, ",\"event\":\"");
+        putString(writer, event);
+        putChar(writer, '"');
+    }
+    else
+    {
+        putCsv(writer, writer->path);
+        putChar(writer, ',');
+        putString(writer, event);
+        putChar(writer, ',');
+    }
+}
+
+/**
+ * @brief end a record, and write it out if the writer is eager.
+ *
+ * @param writer the writer.
+ */
+static void endRecord(reportWriter *writer)
+{
+    if (writer->format == REPORT_JSONL)
+    {
+        putChar(writer, '}');
+    }
+
+    putChar(writer, '\n');
+
+    if (writer->eager)
+    {
+        writeBuffer(writer);
+        fflush(writer->out);
+    }
+}
+
+bool reportInit(reportWriter *writer, FILE *out, reportFormat format)
+{
+    memset(writer, 0, sizeof(reportWriter));
+
+    writer->out = out;
+    writer->format = format;
+
+    if (!(writer->buffer = (char *)malloc(REPORT_BUFFER)))
+    {
+        return false;
+    }
+
+    if (format == REPORT_CSV)
+    {
+        putString(writer, "path,event,virus,size,offset,region,detail\n");
+    }
+
+    return true;
+}
+
+void reportFile(reportWriter *writer, const char *path, const char *error)
+{
+    // the records of the previous file are complete
+    if (writer->used >= REPORT_BUFFER / 2)
+    {
+        writeBuffer(writer);
+    }
+
+    writer->path = path;
+
+    if (writer->format == REPORT_TEXT)
+    {
+        if (error)
+        {
+            fprintf(stderr, "!> %s: %s\n", path, error);
+        }
+        else if (writer->namingFiles)
+        {
+            putString(writer, "*> ");
+            putString(writer, path);
+            endRecord(writer);
+        }
+
+        return;
+    }
+
+    if (!error)
+    {
+        return;
+    }
+
+    startRecord(writer, "error");
+
+    if (writer->format == REPORT_JSONL)
+    {
+        putString(writer, ",\"error\":");
+        putJson(writer, error);
+    }
+    else
+    {
+        putString(writer, ",,,,");
+        putCsv(writer, error);
+    }
+
+    endRecord(writer);
+}
+
+void reportHit(reportWriter *writer, const char *name, unsigned int size,
+               unsigned long long offset, const char *region)
+{
+    if (writer->format == REPORT_TEXT)
+    {
+        putString(writer, "# ");
+        putString(writer, name);
+        putString(writer, " (");
+        putDecimal(writer, size);
+        putString(writer, ") @ ");
+
+        if (region)
+        {
+            putString(writer, region);
+            putChar(writer, '+');
+        }
+
+        putOffset(writer, offset);
+        endRecord(writer);
+        return;
+    }
+
+    startRecord(writer, "hit");
+
+    if (writer->format == REPORT_JSONL)
+    {
+        putString(writer, ",\"virus\":");
+        putJson(writer, name);
+        putString(writer, ",\"size\":");
+        putDecimal(writer, size);
+        putString(writer, ",\"offset\":");
+        putDecimal(writer, offset);
+
+        if (region)
+        {
+            putString(writer, ",\"region\":");
+            putJson(writer, region);
+        }
+    }
+    else
+    {
+        putCsv(writer, name);
+        putChar(writer, ',');
+        putDecimal(writer, size);
+        putChar(writer, ',');
+        putDecimal(writer, offset);
+        putChar(writer, ',');
+        putCsv(writer, region);
+        putChar(writer, ',');
+    }
+
+    endRecord(writer);
+}
+
+void reportDigest(reportWriter *writer,
+                  const unsigned char digest[SHA256_SIZE])
+{
+    char hex[2 * SHA256_SIZE];
+
+    reportHex(hex, digest, SHA256_SIZE, false);
+
+    if (writer->format == REPORT_TEXT)
+    {
+        putString(writer, "# known bad sha256 ");
+    }
+    else
+    {
+        startRecord(writer, "known_bad");
+        putString(writer, writer->format == REPORT_JSONL ? ",\"sha256\":\""
+                                                         : ",,,,");
+    }
+
+    put(writer, hex, sizeof(hex));
+
+    if (writer->format == REPORT_JSONL)
+    {
+        putChar(writer, '"');
+    }
+
+    endRecord(writer);
+}
+
+bool reportFlush(reportWriter *writer)
+{
+    writeBuffer(writer);
+
+    if (fflush(writer->out))
+    {
+        writer->failed = true;
+    }
+
+    return !writer->failed;
+}
+
+bool reportClose(reportWriter *writer)
+{
+    bool ok = reportFlush(writer);
+
+    free(writer->buffer);
+    writer->buffer = NULL;
+
+    return ok;
+}
+
+int reportFormatFind(const char *name)
+{
+    int format;
+
+    for (format = REPORT_TEXT; format <= REPORT_CSV; format++)
+    {
+        if (!strcmp(name, formatNames[format]))
+        {
+            return format;
+        }
+    }
+
+    return -1;
+}
+
+size_t reportHex(char *out, const unsigned char *data, size_t length,
+                 bool spaced)
+{
+    char *start = out;
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        memcpy(out, hexPairs + 2 * data[i], 2);
+        out += 2;
+
+        if (spaced)
+        {
+            *out++ = ' ';
+        }
+    }
+
+    return out - start;
+}
@@ -0,0 +1,313 @@
+/**
+ * measurements of the scanning engine: the throughput of the automaton with
+ * every prefilter and every layout and of every engine, on a buffer made of
+ * copies of a sample file, and the throughput and memory of a scan of a
+ * whole file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>           // for open
+#include <unistd.h>          // for close
+#include <sys/stat.h>        // for fstat
+#include <sys/resource.h>    // for getrusage
+#include "../include/streamScan.h"
+#include "../include/readPipeline.h"
+#include "../include/scanBench.h"
+
+static const char *levelNames[] = {"off", "scalar", "sse2", "avx2"};
+
+/**
+ * @brief read a whole file and repeat it until the buffer is full.
+ *
+ * @param sample the file's path.
+ * @param size the size of the buffer.
+ * @return unsigned char* the buffer, or NULL on failure.
+ */
+static unsigned char *tileSample(const char *sample, size_t size)
+{
+    unsigned char *buffer = (unsigned char *)malloc(size);
+    size_t filled = 0, bytesRead;
+    FILE *file = fopen(sample, "r");
+
+    if (!buffer || !file)
+    {
+        free(buffer);
+
+        if (file)
+        {
+            fclose(file);
+        }
+
+        return NULL;
+    }
+
+    while (filled < size &&
+           (bytesRead = fread(buffer + filled, 1, size - filled, file)) > 0)
+    {
+        filled += bytesRead;
+    }
+
+    fclose(file);
+
+    if (filled == 0)
+    {
+        free(buffer);
+        return NULL;
+    }
+
+    // double the copied part until the buffer is full
+    for (bytesRead = filled; filled < size; filled += bytesRead)
+    {
+        bytesRead = filled < size - filled ? filled : size - filled;
+        memcpy(buffer + filled, buffer, bytesRead);
+    }
+
+    return buffer;
+}
+
+double benchClock()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief scan a buffer BENCH_RUNS times.
+ *
+ * @param matcher the matcher.
+ * @param buffer the buffer.
+ * @param size its size.
+ * @param hits receives the hits of a scan.
+ * @param count set to the number of hits.
+ * @return double the seconds of the fastest scan.
+ */
+static double bestScan(const acAutomaton *matcher, const unsigned char *buffer,
+                       size_t size, hitBuffer *hits, size_t *count)
+{
+    double best = 0, start, elapsed;
+    int run;
+
+    for (run = 0; run < BENCH_RUNS; run++)
+    {
+        hitClear(hits);
+        start = benchClock();
+        *count = acScan(matcher, buffer, size, hits);
+        elapsed = benchClock() - start;
+
+        if (run == 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+bool benchPrefilter(const acAutomaton *matcher, const char *sample,
+                    unsigned int megabytes)
+{
+    size_t size = (size_t)megabytes << 20, count = 0;
+    unsigned char *buffer = tileSample(sample, size);
+    prefilterLevel previous = prefilterCurrent(), level;
+    hitBuffer hits = {0};
+    double best;
+
+    if (!buffer)
+    {
+        return false;
+    }
+
+    for (level = PREFILTER_OFF; level < PREFILTER_BEST; level++)
+    {
+        if (!prefilterSelect(level))
+        {
+            continue;
+        }
+
+        best = bestScan(matcher, buffer, size, &hits, &count);
+
+        printf("bench=prefilter level=%s bytes=%zu seconds=%.6f "
+               "mb_per_sec=%.1f hits=%zu\n",
+               levelNames[level], size, best,
+               best > 0 ? megabytes / best : 0.0, count);
+    }
+
+    prefilterSelect(previous);
+    hitFree(&hits);
+    free(buffer);
+
+    return true;
+}
+
+bool benchEngines(const sigArena *arena, const char *sample,
+                  unsigned int megabytes)
+{
+    size_t size = (size_t)megabytes << 20, count = 0;
+    unsigned char *buffer = tileSample(sample, size);
+    double best, start, building;
+    hitBuffer hits = {0};
+    acAutomaton *matcher;
+    matchEngine engine, chosen;
+    keyStats stats;
+
+    if (!buffer)
+    {
+        return false;
+    }
+
+    keyStatsCollect(&stats, arena);
+    chosen = engineChoose(&stats);
+
+    for (engine = ENGINE_AUTOMATON; engine < ENGINE_AUTO; engine++)
+    {
+        start = benchClock();
+        matcher = acBuildEngine(arena, engine);
+        building = benchClock() - start;
+
+        if (!matcher)
+        {
+            continue;
+        }
+
+        best = bestScan(matcher, buffer, size, &hits, &count);
+
+        printf("bench=engine engine=%s auto=%s build_seconds=%.6f bytes=%zu "
+               "seconds=%.6f mb_per_sec=%.1f hits=%zu\n",
+               engineName(engine), engine == chosen ? "yes" : "no", building,
+               size, best, best > 0 ? megabytes / best : 0.0, count);
+
+        acFree(matcher);
+    }
+
+    hitFree(&hits);
+    free(buffer);
+
+    return true;
+}
+
+bool benchLayouts(const sigArena *arena, const char *sample,
+                  unsigned int megabytes)
+{
+    size_t size = (size_t)megabytes << 20, count = 0, memory;
+    unsigned char *buffer = tileSample(sample, size);
+    double best, start, building;
+    hitBuffer hits = {0};
+    acAutomaton *matcher;
+    acLayout layout, chosen;
+
+    if (!buffer)
+    {
+        return false;
+    }
+
+    for (layout = AC_LAYOUT_FULL; layout < AC_LAYOUT_AUTO; layout++)
+    {
+        start = benchClock();
+        matcher = acBuildLayout(arena, layout);
+        building = benchClock() - start;
+
+        // a full table of too many states may not fit in memory at all
+        if (!matcher)
+        {
+            printf("bench=layout layout=%s failed=yes\n",
+                   acLayoutName(layout));
+            continue;
+        }
+
+        best = bestScan(matcher, buffer, size, &hits, &count);
+        memory = acMemory(matcher);
+        chosen = matcher->stateCount <= AC_FULL_MAX_STATES ? AC_LAYOUT_FULL
+                                                           : AC_LAYOUT_SPARSE;
+
+        printf("bench=layout layout=%s auto=%s states=%u memory_bytes=%zu "
+               "bytes_per_signature=%.1f build_seconds=%.6f bytes=%zu "
+               "seconds=%.6f mb_per_sec=%.1f hits=%zu\n",
+               acLayoutName(layout), layout == chosen ? "yes" : "no",
+               matcher->stateCount, memory,
+               arena->count ? (double)memory / arena->count : 0.0, building,
+               size, best, best > 0 ? megabytes / best : 0.0, count);
+
+        acFree(matcher);
+    }
+
+    hitFree(&hits);
+    free(buffer);
+
+    return true;
+}
+
+long benchPeakRss()
+{
+    struct rusage usage;
+
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+/**
+ * @brief count a hit.
+ *
+ * @param context a counter.
+ * @param virusIndex unused.
+ * @param offset unused.
+ */
+static void countHit(void *context, unsigned int virusIndex,
+                     unsigned long long offset)
+{
+    (*(unsigned long long *)context)++;
+}
+
+bool benchScanFile(const acAutomaton *matcher, const char *path, int depth,
+                   size_t chunkSize)
+{
+    unsigned long long hits = 0;
+    pipelineStats stats;
+    struct stat info;
+    double start, elapsed;
+    bool ok;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &info) == -1)
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+
+        return false;
+    }
+
+    start = benchClock();
+    ok = depth > 0 ? pipelineScanFd(fd, matcher, depth, chunkSize, countHit,
+                                    &hits, &stats)
+                   : streamScanFd(fd, matcher, countHit, &hits);
+    elapsed = benchClock() - start;
+
+    close(fd);
+
+    if (ok)
+    {
+        printf("bench=scan file=%s bytes=%lld seconds=%.6f mb_per_sec=%.1f "
+               "hits=%llu peak_rss_kb=%ld",
+               path, (long long)info.st_size, elapsed,
+               elapsed > 0 ? info.st_size / elapsed / (1 << 20) : 0.0, hits,
+               benchPeakRss());
+
+        if (depth > 0)
+        {
+            printf(" depth=%d chunk=%zu reader_stall_sec=%.6f "
+                   "scanner_stall_sec=%.6f",
+                   depth, chunkSize, stats.readerSeconds,
+                   stats.scannerSeconds);
+        }
+
+        printf("\n");
+    }
+
+    return ok;
+}
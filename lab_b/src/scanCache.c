@@ -0,0 +1,261 @@
+/**
+ * a persistent cache of the verdicts of a directory sweep.
+ *
+ * a file is identified by its device and inode, and is considered unchanged
+ * while its size, modification time and status change time are the same.
+ * the modification time can be set back after the contents change, the
+ * status change time can't. the cache file is a header followed by an array
+ * sorted by device and inode, so it is mapped and searched as is. a sweep
+ * appends every file it sees to an array of updates, which replaces the
+ * mapped entries when the sweep is done, so the files that are gone are
+ * dropped rather than kept forever.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/limits.h> // for PATH_MAX
+#include <fcntl.h>        // for open
+#include <unistd.h>       // for close
+#include <sys/mman.h>     // for mmap
+#include "../include/scanCache.h"
+
+#define INITIAL_UPDATES 256
+
+/**
+ * @brief order entries by device and then by inode.
+ */
+static int compareEntries(const void *a, const void *b)
+{
+    const cacheEntry *first = (const cacheEntry *)a;
+    const cacheEntry *second = (const cacheEntry *)b;
+
+    if (first->device != second->device)
+    {
+        return (first->device > second->device) -
+               (first->device < second->device);
+    }
+
+    return (first->inode > second->inode) - (first->inode < second->inode);
+}
+
+/**
+ * @brief describe a file as an entry.
+ *
+ * @param entry the entry to fill.
+ * @param info the file's status.
+ * @param verdict the file's verdict.
+ */
+static void fillEntry(cacheEntry *entry, const struct stat *info,
+                      cacheVerdict verdict)
+{
+    memset(entry, 0, sizeof(cacheEntry));
+
+    entry->device = info->st_dev;
+    entry->inode = info->st_ino;
+    entry->size = info->st_size;
+    entry->mtimeSeconds = info->st_mtim.tv_sec;
+    entry->mtimeNanoseconds = info->st_mtim.tv_nsec;
+    entry->ctimeSeconds = info->st_ctim.tv_sec;
+    entry->ctimeNanoseconds = info->st_ctim.tv_nsec;
+    entry->verdict = verdict;
+}
+
+/**
+ * @brief check that a header describes a cache this build can use.
+ *
+ * @param header a header.
+ * @param size the size of the file.
+ * @param sigVersion the digest of the current signatures.
+ * @return true if the entries can be used.
+ */
+static bool validHeader(const cacheHeader *header, size_t size,
+                        uint64_t sigVersion)
+{
+    return size >= sizeof(cacheHeader) &&
+           !memcmp(header->magic, CACHE_MAGIC, 4) &&
+           header->version == CACHE_VERSION &&
+           header->byteOrder == CACHE_BYTE_ORDER &&
+           header->entrySize == sizeof(cacheEntry) &&
+           header->sigVersion == sigVersion &&
+           header->count == (size - sizeof(cacheHeader)) / sizeof(cacheEntry) &&
+           (size - sizeof(cacheHeader)) % sizeof(cacheEntry) == 0;
+}
+
+bool cacheOpen(scanCache *cache, const char *path, uint64_t sigVersion,
+               bool rescan)
+{
+    struct stat info;
+    void *data;
+    int fd;
+
+    memset(cache, 0, sizeof(scanCache));
+
+    if (!(cache->path = strdup(path)))
+    {
+        return false;
+    }
+
+    cache->sigVersion = sigVersion;
+    cache->rescan = rescan;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+    {
+        return true;
+    }
+
+    if (fstat(fd, &info) != -1 && (uintmax_t)info.st_size <= SIZE_MAX &&
+        (size_t)info.st_size >= sizeof(cacheHeader) &&
+        (data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) !=
+            MAP_FAILED)
+    {
+        cache->base = data;
+        cache->size = info.st_size;
+
+        // entries of other signatures are dropped with the whole file
+        if (validHeader((const cacheHeader *)data, cache->size, sigVersion))
+        {
+            cache->entries = (const cacheEntry *)((cacheHeader *)data + 1);
+            cache->count = ((const cacheHeader *)data)->count;
+        }
+    }
+
+    close(fd);
+
+    return true;
+}
+
+bool cacheLookup(const scanCache *cache, const struct stat *info,
+                 cacheVerdict *verdict)
+{
+    cacheEntry key;
+    const cacheEntry *found;
+
+    if (cache->rescan || cache->count == 0)
+    {
+        return false;
+    }
+
+    fillEntry(&key, info, VERDICT_CLEAN);
+
+    found = (const cacheEntry *)bsearch(&key, cache->entries, cache->count,
+                                        sizeof(cacheEntry), compareEntries);
+
+    if (!found || found->size != key.size ||
+        found->mtimeSeconds != key.mtimeSeconds ||
+        found->mtimeNanoseconds != key.mtimeNanoseconds ||
+        found->ctimeSeconds != key.ctimeSeconds ||
+        found->ctimeNanoseconds != key.ctimeNanoseconds)
+    {
+        return false;
+    }
+
+    *verdict = found->verdict;
+
+    return true;
+}
+
+void cacheRecord(scanCache *cache, const struct stat *info,
+                 cacheVerdict verdict)
+{
+    cacheEntry *grown;
+
+    if (cache->updateCount == cache->updateCapacity)
+    {
+        cache->updateCapacity = cache->updateCapacity
+                                    ? cache->updateCapacity * 2
+                                    : INITIAL_UPDATES;
+        grown = (cacheEntry *)realloc(cache->updates, cache->updateCapacity *
+                                                          sizeof(cacheEntry));
+
+        // the file is scanned again by the next sweep
+        if (!grown)
+        {
+            cache->updateCapacity = cache->updateCount;
+            return;
+        }
+
+        cache->updates = grown;
+    }
+
+    fillEntry(&cache->updates[cache->updateCount++], info, verdict);
+}
+
+/**
+ * @brief write the entries of the files seen, once per file.
+ *
+ * @param cache a cache whose updates are sorted.
+ * @param file an output stream.
+ * @return uint64_t the number of entries written.
+ */
+static uint64_t writeEntries(const scanCache *cache, FILE *file)
+{
+    const cacheEntry *last = NULL;
+    uint64_t written = 0;
+    size_t i;
+
+    for (i = 0; i < cache->updateCount; i++)
+    {
+        // hard links are seen once per path
+        if (!last || compareEntries(last, &cache->updates[i]))
+        {
+            fwrite(&cache->updates[i], sizeof(cacheEntry), 1, file);
+            written++;
+        }
+
+        last = &cache->updates[i];
+    }
+
+    return written;
+}
+
+bool cacheSave(scanCache *cache)
+{
+    char temporary[PATH_MAX];
+    cacheHeader header;
+    bool ok;
+    FILE *file;
+
+    if (snprintf(temporary, PATH_MAX, "%s.tmp", cache->path) >= PATH_MAX ||
+        !(file = fopen(temporary, "w")))
+    {
+        return false;
+    }
+
+    qsort(cache->updates, cache->updateCount, sizeof(cacheEntry),
+          compareEntries);
+
+    memset(&header, 0, sizeof(cacheHeader));
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.byteOrder = CACHE_BYTE_ORDER;
+    header.entrySize = sizeof(cacheEntry);
+    header.sigVersion = cache->sigVersion;
+
+    // the count is known once the entries are written
+    ok = fwrite(&header, sizeof(cacheHeader), 1, file) == 1;
+    header.count = writeEntries(cache, file);
+    ok = ok && !ferror(file) && fseek(file, 0, SEEK_SET) == 0 &&
+         fwrite(&header, sizeof(cacheHeader), 1, file) == 1;
+
+    if (fclose(file) == EOF || !ok || rename(temporary, cache->path) == -1)
+    {
+        remove(temporary);
+        return false;
+    }
+
+    return true;
+}
+
+void cacheClose(scanCache *cache)
+{
+    if (cache->base)
+    {
+        munmap(cache->base, cache->size);
+    }
+
+    free(cache->updates);
+    free(cache->path);
+
+    memset(cache, 0, sizeof(scanCache));
+}
@@ -0,0 +1,220 @@
+/**
+NAME
+    scanClient - asks a virusDetector daemon to scan files.
+SYNOPSIS
+    scanClient SOCKET [-fd] FILE...
+DESCRIPTION
+    scanClient sends a request per FILE to the daemon listening on SOCKET
+    (see virusDetector -daemon), one after the other on a single connection,
+    and prints every line of each answer after file=FILE.
+    -fd - open the files here and send their descriptors, so the daemon can
+    scan files it has no permission to open. Otherwise the daemon is sent
+    their absolute paths.
+    The exit status is 0 if every file is clean, 1 if a virus was found and
+    2 if a file couldn't be scanned.
+EXAMPLES
+    scanClient /tmp/virusDetector.sock infected
+    scanClient /tmp/virusDetector.sock -fd upload-1 upload-2
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../include/scanDaemon.h"
+
+#define EXIT_CLEAN 0
+#define EXIT_INFECTED 1
+#define EXIT_FAILED 2
+
+#define PRINT_ERROR(MSG) fprintf(stderr, "!> %s\n", MSG)
+
+/**
+ * @brief connect to the daemon.
+ *
+ * @param path the path of its socket.
+ * @return int the connected socket, or -1 on failure.
+ */
+int connectTo(const char *path)
+{
+    struct sockaddr_un address;
+    int connection;
+
+    if (strlen(path) >= sizeof(address.sun_path) ||
+        (connection = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    if (connect(connection, (struct sockaddr *)&address, sizeof(address)) ==
+        -1)
+    {
+        close(connection);
+        return -1;
+    }
+
+    return connection;
+}
+
+/**
+ * @brief send a request, and a descriptor with it unless fd is -1.
+ *
+ * @param connection the socket.
+ * @param request the request line, with its line break.
+ * @param fd a descriptor, or -1.
+ * @return true if the whole request was sent.
+ */
+bool sendRequest(int connection, const char *request, int fd)
+{
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message;
+    struct cmsghdr *header;
+    struct iovec data;
+    size_t length = strlen(request);
+    ssize_t sent;
+
+    memset(&message, 0, sizeof(message));
+    data.iov_base = (void *)request;
+    data.iov_len = length;
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+
+    // the descriptor goes with the first byte of the request
+    if (fd != -1)
+    {
+        memset(&control, 0, sizeof(control));
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    }
+
+    while (data.iov_len > 0)
+    {
+        if ((sent = sendmsg(connection, &message, MSG_NOSIGNAL)) == -1)
+        {
+            return false;
+        }
+
+        data.iov_base = (char *)data.iov_base + sent;
+        data.iov_len -= sent;
+        message.msg_control = NULL;
+        message.msg_controllen = 0;
+    }
+
+    return true;
+}
+
+/**
+ * @brief print the answer of the daemon to a request, up to its verdict.
+ *
+ * @param answers the stream of the answers.
+ * @param file the file the request was about.
+ * @return int the exit status of the file.
+ */
+int printAnswer(FILE *answers, const char *file)
+{
+    char line[DAEMON_LINE_MAX];
+    const char *verdict = line + strlen(RESPONSE_VERDICT);
+
+    while (fgets(line, sizeof(line), answers))
+    {
+        printf("file=%s %s", file, line);
+
+        if (!strncmp(line, RESPONSE_VERDICT, strlen(RESPONSE_VERDICT)))
+        {
+            return !strncmp(verdict, "clean ", 6)      ? EXIT_CLEAN
+                   : !strncmp(verdict, "infected ", 9) ? EXIT_INFECTED
+                                                       : EXIT_FAILED;
+        }
+    }
+
+    printf("file=%s %serror error=the daemon hung up\n", file,
+           RESPONSE_VERDICT);
+
+    return EXIT_FAILED;
+}
+
+int main(int argc, char **argv)
+{
+    char request[DAEMON_LINE_MAX], path[PATH_MAX];
+    int connection, fd, status = EXIT_CLEAN, fileStatus, first = 2, i;
+    bool passing;
+    FILE *answers;
+
+    passing = argc > 2 && !strcmp(argv[2], "-fd");
+    first += passing;
+
+    if (argc <= first)
+    {
+        PRINT_ERROR("usage: scanClient SOCKET [-fd] FILE...");
+        return EXIT_FAILED;
+    }
+
+    if ((connection = connectTo(argv[1])) == -1 ||
+        !(answers = fdopen(dup(connection), "r")))
+    {
+        PRINT_ERROR("couldn't connect to the daemon");
+        return EXIT_FAILED;
+    }
+
+    for (i = first; i < argc; i++)
+    {
+        fd = -1;
+
+        if (passing)
+        {
+            fd = open(argv[i], O_RDONLY);
+            snprintf(request, sizeof(request), "%s\n", REQUEST_FD);
+        }
+        else
+        {
+            snprintf(request, sizeof(request), "%s%s\n", REQUEST_SCAN,
+                     realpath(argv[i], path) ? path : argv[i]);
+        }
+
+        if (passing && fd == -1)
+        {
+            printf("file=%s %serror error=couldn't open the file\n", argv[i],
+                   RESPONSE_VERDICT);
+            fileStatus = EXIT_FAILED;
+        }
+        else if (!sendRequest(connection, request, fd))
+        {
+            printf("file=%s %serror error=the daemon hung up\n", argv[i],
+                   RESPONSE_VERDICT);
+            fileStatus = EXIT_FAILED;
+        }
+        else
+        {
+            fileStatus = printAnswer(answers, argv[i]);
+        }
+
+        if (fd != -1)
+        {
+            close(fd);
+        }
+
+        status = fileStatus > status ? fileStatus : status;
+    }
+
+    fclose(answers);
+    close(connection);
+
+    return status;
+}
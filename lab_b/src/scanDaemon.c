@@ -0,0 +1,783 @@
+/**
+ * a scanning daemon on a UNIX domain socket.
+ *
+ * the signatures are loaded once. a single thread polls the listening
+ * socket and every connection, and hands each request line received whole
+ * to a worker of a pool, so the workers only ever scan and a client that
+ * stays connected without asking for anything holds none of them. the
+ * connection of a request being served isn't polled until it is answered,
+ * so the requests of a client are answered in order. a client names a file
+ * by its path, or sends a descriptor of it with SCM_RIGHTS, so it can have
+ * the daemon scan files it can read and the daemon can't open.
+ *
+ * as SCAN opens files with the daemon's privileges, the socket is created
+ * for the daemon's user only.
+ *
+ * SIGHUP reloads the signatures on a thread of their own, so the clients
+ * are served by the old generation until the new one is published. a
+ * request holds the generation it started with until its verdict is sent.
+ */
+
+#define _GNU_SOURCE // for ppoll and accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "../include/scanDaemon.h"
+#include "../include/streamScan.h"
+#include "../include/sigPattern.h"
+#include "../include/workPool.h"
+
+#define OPEN_ERROR "couldn't open the file"
+#define READ_ERROR "failed reading the file"
+#define NO_FD_ERROR "no descriptor was sent"
+#define UNKNOWN_ERROR "unknown request"
+#define LENGTH_ERROR "request too long"
+
+typedef struct daemonServer
+{
+    sigLibrary library;
+    generationLoader load;
+    workPool *pool;
+    pthread_mutex_t lock;   // guards summary and the reload state
+    daemonSummary *summary;
+    pthread_t builder;      // loads the generations asked for by SIGHUP
+    bool builderStarted;
+    bool building;
+    bool reloadPending;     // another SIGHUP came while building
+    int wakeup;             // written when a request was answered
+} daemonServer;
+
+typedef struct clientConnection
+{
+    daemonServer *server;
+    int socket;
+    FILE *out;                  // the responses, flushed after every verdict
+    int fds[DAEMON_MAX_FDS];    // received and not yet scanned, oldest first
+    int fdCount;
+    char line[DAEMON_LINE_MAX]; // the requests received so far
+    size_t filled, consumed;
+    hitBuffer hits;
+    bool busy;                  // a worker serves a request, guarded by lock
+    bool hungUp;                // nothing more will be received
+    bool broken;                // the responses can't be written
+    double lastActive;          // when it last sent or was answered
+} clientConnection;
+
+static volatile sig_atomic_t stopping = 0;
+static volatile sig_atomic_t reloading = 0;
+
+/**
+ * @brief ask the daemon to stop.
+ */
+static void requestStop(int signal)
+{
+    stopping = 1;
+}
+
+/**
+ * @brief ask the daemon to reload its signatures.
+ */
+static void requestReload(int signal)
+{
+    reloading = 1;
+}
+
+/**
+ * @brief the time, in seconds, that idle clients are measured with.
+ */
+static double daemonClock()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief append a hit to a hit buffer.
+ */
+static void addHit(void *context, unsigned int virusIndex,
+                   unsigned long long offset)
+{
+    hitAppend((hitBuffer *)context, virusIndex, offset);
+}
+
+/**
+ * @brief queue the descriptors of a received message, closing the ones that
+ * don't fit.
+ *
+ * @param client a connection.
+ * @param message a received message.
+ */
+static void queueDescriptors(clientConnection *client, struct msghdr *message)
+{
+    struct cmsghdr *header;
+    int count, fd, i;
+
+    for (header = CMSG_FIRSTHDR(message); header;
+         header = CMSG_NXTHDR(message, header))
+    {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+        {
+            continue;
+        }
+
+        count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+        for (i = 0; i < count; i++)
+        {
+            memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+
+            if (client->fdCount < DAEMON_MAX_FDS)
+            {
+                client->fds[client->fdCount++] = fd;
+            }
+            else
+            {
+                close(fd);
+            }
+        }
+    }
+}
+
+/**
+ * @brief drop the request lines already answered from the line buffer.
+ *
+ * @param client a connection.
+ */
+static void dropLines(clientConnection *client)
+{
+    memmove(client->line, client->line + client->consumed,
+            client->filled - client->consumed);
+    client->filled -= client->consumed;
+    client->consumed = 0;
+}
+
+/**
+ * @brief receive what a client sent, without waiting.
+ *
+ * @param client a connection that isn't being served.
+ */
+static void receive(clientConnection *client)
+{
+    union
+    {
+        char buffer[CMSG_SPACE(DAEMON_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec data;
+    struct msghdr message;
+    ssize_t received;
+
+    dropLines(client);
+
+    data.iov_base = client->line + client->filled;
+    data.iov_len = DAEMON_LINE_MAX - client->filled;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    do
+    {
+        received = recvmsg(client->socket, &message,
+                           MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    } while (received == -1 && errno == EINTR);
+
+    if (received > 0)
+    {
+        queueDescriptors(client, &message);
+        client->filled += received;
+    }
+    else if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        client->hungUp = true;
+    }
+}
+
+/**
+ * @brief take the next complete request line of a client.
+ *
+ * @param client a connection.
+ * @return char* the line without its line break, or NULL if no complete
+ * line was received yet.
+ */
+static char *nextLine(clientConnection *client)
+{
+    char *end;
+    size_t length;
+
+    dropLines(client);
+
+    if (!(end = memchr(client->line, '\n', client->filled)))
+    {
+        return NULL;
+    }
+
+    length = end - client->line;
+    client->consumed = length + 1;
+    *end = '\0';
+
+    if (length > 0 && client->line[length - 1] == '\r')
+    {
+        client->line[length - 1] = '\0';
+    }
+
+    return client->line;
+}
+
+/**
+ * @brief scan a file and answer with its hits and its verdict.
+ *
+ * @param client a connection.
+ * @param fd the file.
+ */
+static void scanAndReply(clientConnection *client, int fd)
+{
+    sigGeneration *generation = libraryAcquire(&client->server->library);
+    const acAutomaton *matcher = generation->matcher;
+    daemonSummary *summary = client->server->summary;
+    virus *vir;
+    bool ok;
+    size_t i;
+
+    hitClear(&client->hits);
+    ok = streamScanFd(fd, matcher, addHit, &client->hits);
+
+    pthread_mutex_lock(&client->server->lock);
+    summary->failed += !ok;
+    summary->infected += ok && client->hits.count > 0;
+    pthread_mutex_unlock(&client->server->lock);
+
+    if (!ok)
+    {
+        fprintf(client->out, "%serror error=%s\n", RESPONSE_VERDICT,
+                READ_ERROR);
+        generationRelease(generation);
+        return;
+    }
+
+    // the hits are indices into this generation's viruses
+    for (i = 0; i < client->hits.count; i++)
+    {
+        vir = acVirus(matcher, client->hits.hits[i].virusIndex);
+        fprintf(client->out, "%sname=%.16s size=%d offset=0x%04llx\n",
+                RESPONSE_HIT, vir->virusName, virusLength(vir),
+                client->hits.hits[i].offset);
+    }
+
+    fprintf(client->out, "%s%s hits=%zu\n", RESPONSE_VERDICT,
+            client->hits.count ? "infected" : "clean", client->hits.count);
+
+    generationRelease(generation);
+}
+
+/**
+ * @brief answer a single request.
+ *
+ * @param client a connection.
+ * @param line the request.
+ */
+static void handleRequest(clientConnection *client, const char *line)
+{
+    const char *error = NULL;
+    int fd = -1;
+
+    if (!strncmp(line, REQUEST_SCAN, strlen(REQUEST_SCAN)))
+    {
+        fd = open(line + strlen(REQUEST_SCAN), O_RDONLY | O_CLOEXEC);
+        error = fd == -1 ? OPEN_ERROR : NULL;
+    }
+    else if (!strcmp(line, REQUEST_FD))
+    {
+        if (client->fdCount > 0)
+        {
+            fd = client->fds[0];
+            memmove(client->fds, client->fds + 1,
+                    --client->fdCount * sizeof(int));
+        }
+
+        error = fd == -1 ? NO_FD_ERROR : NULL;
+    }
+    else
+    {
+        error = UNKNOWN_ERROR;
+    }
+
+    pthread_mutex_lock(&client->server->lock);
+    client->server->summary->requests++;
+    client->server->summary->failed += error != NULL;
+    pthread_mutex_unlock(&client->server->lock);
+
+    if (error)
+    {
+        fprintf(client->out, "%serror error=%s\n", RESPONSE_VERDICT, error);
+        return;
+    }
+
+    scanAndReply(client, fd);
+    close(fd);
+}
+
+/**
+ * @brief answer the next request of a client, and hand it back to the loop
+ * waiting for requests.
+ *
+ * @param argument a clientConnection with a complete request line.
+ * @param worker unused.
+ */
+static void serveRequest(void *argument, int worker)
+{
+    clientConnection *client = (clientConnection *)argument;
+    daemonServer *server = client->server;
+    ssize_t written;
+    char *line;
+
+    if ((line = nextLine(client)))
+    {
+        handleRequest(client, line);
+    }
+
+    pthread_mutex_lock(&server->lock);
+    client->broken = fflush(client->out) == EOF;
+    client->lastActive = daemonClock();
+    client->busy = false;
+    pthread_mutex_unlock(&server->lock);
+
+    // wake the loop up, it waits for the client again. the pipe is only
+    // full, EAGAIN, while the loop has wakeups to read, which is enough
+    do
+    {
+        written = write(server->wakeup, "", 1);
+    } while (written == -1 && errno == EINTR);
+}
+
+/**
+ * @brief open a connection to a client that was just accepted.
+ *
+ * @param server the daemon.
+ * @param socket the client's socket.
+ * @return clientConnection* the connection, or NULL on failure.
+ */
+static clientConnection *openClient(daemonServer *server, int socket)
+{
+    clientConnection *client;
+    int fd;
+
+    if (!(client = (clientConnection *)calloc(1, sizeof(clientConnection))))
+    {
+        return NULL;
+    }
+
+    // the responses are written through a stream of their own descriptor
+    if ((fd = dup(socket)) == -1 || !(client->out = fdopen(fd, "w")))
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+
+        free(client);
+        return NULL;
+    }
+
+    client->server = server;
+    client->socket = socket;
+    client->lastActive = daemonClock();
+
+    return client;
+}
+
+/**
+ * @brief close a connection that isn't being served.
+ *
+ * @param client the connection.
+ */
+static void closeClient(clientConnection *client)
+{
+    int i;
+
+    for (i = 0; i < client->fdCount; i++)
+    {
+        close(client->fds[i]);
+    }
+
+    fclose(client->out);
+    close(client->socket);
+    hitFree(&client->hits);
+    free(client);
+}
+
+/**
+ * @brief hand the next request of a client that isn't being served to a
+ * worker, if it was received whole.
+ *
+ * @param server the daemon.
+ * @param client the connection.
+ * @return true if the connection is still open, false if it was closed.
+ */
+static bool dispatch(daemonServer *server, clientConnection *client)
+{
+    dropLines(client);
+
+    if (memchr(client->line, '\n', client->filled))
+    {
+        pthread_mutex_lock(&server->lock);
+        client->busy = true;
+        pthread_mutex_unlock(&server->lock);
+
+        if (!poolSubmit(server->pool, serveRequest, client, POOL_ANY_WORKER))
+        {
+            serveRequest(client, 0);
+        }
+
+        return true;
+    }
+
+    // a line too long to be received, a client that hung up, and one that
+    // can't be written to are done
+    if (client->filled == DAEMON_LINE_MAX)
+    {
+        fprintf(client->out, "%serror error=%s\n", RESPONSE_VERDICT,
+                LENGTH_ERROR);
+        client->hungUp = true;
+    }
+
+    if (client->hungUp || client->broken)
+    {
+        closeClient(client);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief load generations until no reload is pending, publishing each one.
+ *
+ * @param argument the daemonServer.
+ * @return void* NULL.
+ */
+static void *rebuild(void *argument)
+{
+    daemonServer *server = (daemonServer *)argument;
+    sigGeneration *generation;
+
+    pthread_mutex_lock(&server->lock);
+
+    while (server->reloadPending)
+    {
+        server->reloadPending = false;
+        pthread_mutex_unlock(&server->lock);
+
+        if ((generation = server->load()))
+        {
+            libraryPublish(&server->library, generation);
+        }
+
+        pthread_mutex_lock(&server->lock);
+        server->summary->reloads += generation != NULL;
+        server->summary->failedReloads += generation == NULL;
+    }
+
+    server->building = false;
+    pthread_mutex_unlock(&server->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief start loading a new generation, or have the one being loaded
+ * followed by another if the signatures changed again meanwhile.
+ *
+ * @param server the daemon.
+ */
+static void startReload(daemonServer *server)
+{
+    pthread_mutex_lock(&server->lock);
+    server->reloadPending = true;
+
+    if (!server->building)
+    {
+        // a builder that isn't building has returned, or is about to
+        if (server->builderStarted)
+        {
+            pthread_join(server->builder, NULL);
+        }
+
+        server->builderStarted = server->building =
+            pthread_create(&server->builder, NULL, rebuild, server) == 0;
+        server->reloadPending = server->building;
+    }
+
+    pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * @brief create the listening socket, replacing a socket left by a daemon
+ * that died. anything else at the path is kept.
+ *
+ * @param path the path of the socket.
+ * @return int the socket, or -1 on failure.
+ */
+static int listenAt(const char *path)
+{
+    struct sockaddr_un address;
+    struct stat info;
+    mode_t previousMask;
+    int listener, bound;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+    {
+        unlink(path);
+    }
+
+    if ((listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+    {
+        return -1;
+    }
+
+    // only the daemon's user may connect, SCAN opens files as the daemon
+    previousMask = umask(077);
+    bound = bind(listener, (struct sockaddr *)&address, sizeof(address));
+    umask(previousMask);
+
+    if (bound == -1 || listen(listener, DAEMON_BACKLOG) == -1)
+    {
+        close(listener);
+        return -1;
+    }
+
+    return listener;
+}
+
+bool daemonServe(const char *path, sigGeneration *first,
+                 generationLoader load, int threadCount,
+                 daemonSummary *summary)
+{
+    struct sigaction action, previousInterrupt, previousTerminate,
+        previousHangup;
+    sigset_t stopSignals, previousMask;
+    struct pollfd waiting[DAEMON_MAX_CLIENTS + 2];
+    clientConnection *clients[DAEMON_MAX_CLIENTS];
+    daemonServer server;
+    clientConnection *client;
+    struct timespec timeout;
+    double now, deadline;
+    char drained[64];
+    int listener, clientSocket, wakeup[2], clientCount = 0, i, kept;
+    bool busy;
+
+    memset(summary, 0, sizeof(daemonSummary));
+    memset(&server, 0, sizeof(daemonServer));
+    server.load = load;
+    server.summary = summary;
+
+    if ((listener = listenAt(path)) == -1)
+    {
+        generationRelease(first);
+        return false;
+    }
+
+    if (pipe2(wakeup, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        close(listener);
+        unlink(path);
+        generationRelease(first);
+        return false;
+    }
+
+    server.wakeup = wakeup[1];
+
+    // the signals are only taken by this thread, while it waits for clients
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigaddset(&stopSignals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &previousMask);
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, &previousInterrupt);
+    sigaction(SIGTERM, &action, &previousTerminate);
+    action.sa_handler = requestReload;
+    sigaction(SIGHUP, &action, &previousHangup);
+
+    // a client that hangs up early fails a write, it doesn't kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    stopping = 0;
+    reloading = 0;
+
+    if (!(server.pool = poolCreate(threadCount)))
+    {
+        close(listener);
+        close(wakeup[0]);
+        close(wakeup[1]);
+        unlink(path);
+        generationRelease(first);
+        sigaction(SIGINT, &previousInterrupt, NULL);
+        sigaction(SIGTERM, &previousTerminate, NULL);
+        sigaction(SIGHUP, &previousHangup, NULL);
+        pthread_sigmask(SIG_SETMASK, &previousMask, NULL);
+        return false;
+    }
+
+    pthread_mutex_init(&server.lock, NULL);
+    libraryInit(&server.library, first);
+
+    while (!stopping)
+    {
+        if (reloading)
+        {
+            reloading = 0;
+            startReload(&server);
+        }
+
+        // the wakeup, the listener unless the clients are too many, and the
+        // clients waiting for a request, which time out when idle
+        waiting[0].fd = wakeup[0];
+        waiting[1].fd = clientCount < DAEMON_MAX_CLIENTS ? listener : -1;
+        deadline = 0;
+
+        for (i = 0; i < clientCount; i++)
+        {
+            pthread_mutex_lock(&server.lock);
+            busy = clients[i]->busy;
+            pthread_mutex_unlock(&server.lock);
+
+            waiting[i + 2].fd = busy ? -1 : clients[i]->socket;
+
+            if (!busy && (!deadline || clients[i]->lastActive < deadline))
+            {
+                deadline = clients[i]->lastActive;
+            }
+        }
+
+        for (i = 0; i < clientCount + 2; i++)
+        {
+            waiting[i].events = POLLIN;
+            waiting[i].revents = 0;
+        }
+
+        if (deadline)
+        {
+            deadline += DAEMON_IDLE_SECONDS - daemonClock();
+            deadline = deadline > 0 ? deadline : 0;
+            timeout.tv_sec = (time_t)deadline;
+            timeout.tv_nsec = (long)((deadline - timeout.tv_sec) * 1e9);
+        }
+
+        // interrupted by a signal, the loop checks the flags again
+        if (ppoll(waiting, clientCount + 2, deadline ? &timeout : NULL,
+                  &previousMask) == -1)
+        {
+            continue;
+        }
+
+        while (waiting[0].revents && read(wakeup[0], drained, sizeof(drained))
+                                         > 0)
+        {
+        }
+
+        now = daemonClock();
+
+        for (i = kept = 0; i < clientCount; i++)
+        {
+            client = clients[i];
+
+            pthread_mutex_lock(&server.lock);
+            busy = client->busy;
+            pthread_mutex_unlock(&server.lock);
+
+            if (!busy && waiting[i + 2].fd != -1 && waiting[i + 2].revents)
+            {
+                receive(client);
+                client->lastActive = now;
+            }
+            else if (!busy && now - client->lastActive >= DAEMON_IDLE_SECONDS)
+            {
+                client->hungUp = true;
+            }
+
+            if (busy || dispatch(&server, client))
+            {
+                clients[kept++] = client;
+            }
+        }
+
+        clientCount = kept;
+
+        if (!(waiting[1].revents & POLLIN) ||
+            (clientSocket = accept4(listener, NULL, NULL, SOCK_CLOEXEC)) == -1)
+        {
+            continue;
+        }
+
+        if (!(client = openClient(&server, clientSocket)))
+        {
+            close(clientSocket);
+            continue;
+        }
+
+        clients[clientCount++] = client;
+
+        pthread_mutex_lock(&server.lock);
+        summary->connections++;
+        pthread_mutex_unlock(&server.lock);
+    }
+
+    // no new clients, and the ones connected finish their current request
+    close(listener);
+    unlink(path);
+    poolDestroy(server.pool);
+
+    for (i = 0; i < clientCount; i++)
+    {
+        closeClient(clients[i]);
+    }
+
+    close(wakeup[0]);
+    close(wakeup[1]);
+
+    // a generation being loaded is published, and freed with the library
+    pthread_mutex_lock(&server.lock);
+    server.reloadPending = false;
+    pthread_mutex_unlock(&server.lock);
+
+    if (server.builderStarted)
+    {
+        pthread_join(server.builder, NULL);
+    }
+
+    libraryFree(&server.library);
+    pthread_mutex_destroy(&server.lock);
+
+    sigaction(SIGINT, &previousInterrupt, NULL);
+    sigaction(SIGTERM, &previousTerminate, NULL);
+    sigaction(SIGHUP, &previousHangup, NULL);
+    pthread_sigmask(SIG_SETMASK, &previousMask, NULL);
+
+    return true;
+}
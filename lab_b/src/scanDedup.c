@@ -0,0 +1,323 @@
+/**
+ * finding identical files during a sweep.
+ *
+ * hard links are found by their device and inode without reading them, and
+ * copies by their size and a hash of their content, computed with XXH64
+ * because it reads as fast as memory does. both go to an open-addressing
+ * table with linear probing, which is never deleted from during a sweep.
+ * XXH64 can be made to collide on purpose, so files with the same hash are
+ * compared byte by byte before one is taken for a copy of the other.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "../include/scanDedup.h"
+
+#define INITIAL_SLOTS 1024
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTATE(X, R) (((X) << (R)) | ((X) >> (64 - (R))))
+
+/**
+ * @brief the slot of a key, or of the empty slot it would go to.
+ */
+static dedupSlot *findSlot(const dedupTable *table, uint64_t first,
+                           uint64_t second)
+{
+    uint64_t mixed = (first ^ (second * PRIME64_1)) * PRIME64_2;
+    size_t index = (mixed ^ (mixed >> 29)) & (table->capacity - 1);
+
+    while (table->slots[index].value &&
+           (table->slots[index].first != first ||
+            table->slots[index].second != second))
+    {
+        index = (index + 1) & (table->capacity - 1);
+    }
+
+    return &table->slots[index];
+}
+
+/**
+ * @brief double the slots of a table, or allocate its first ones.
+ *
+ * @return true on success.
+ */
+static bool growTable(dedupTable *table)
+{
+    dedupTable grown = *table;
+    size_t i;
+
+    grown.capacity = table->capacity ? table->capacity * 2 : INITIAL_SLOTS;
+
+    if (!(grown.slots = (dedupSlot *)calloc(grown.capacity,
+                                            sizeof(dedupSlot))))
+    {
+        return false;
+    }
+
+    for (i = 0; i < table->capacity; i++)
+    {
+        if (table->slots[i].value)
+        {
+            *findSlot(&grown, table->slots[i].first, table->slots[i].second) =
+                table->slots[i];
+        }
+    }
+
+    free(table->slots);
+    *table = grown;
+
+    return true;
+}
+
+void *dedupFind(dedupTable *table, uint64_t first, uint64_t second)
+{
+    void *value;
+
+    table->lookups++;
+
+    if (!table->count)
+    {
+        return NULL;
+    }
+
+    value = findSlot(table, first, second)->value;
+    table->hits += value != NULL;
+
+    return value;
+}
+
+bool dedupInsert(dedupTable *table, uint64_t first, uint64_t second,
+                 void *value)
+{
+    dedupSlot *slot;
+
+    // at most half full, so probes stay short
+    if ((table->count + 1) * 2 > table->capacity && !growTable(table))
+    {
+        return false;
+    }
+
+    slot = findSlot(table, first, second);
+    slot->first = first;
+    slot->second = second;
+    slot->value = value;
+    table->count++;
+
+    return true;
+}
+
+void dedupFree(dedupTable *table)
+{
+    free(table->slots);
+    memset(table, 0, sizeof(dedupTable));
+}
+
+/**
+ * @brief mix 8 bytes into a lane of the hash.
+ */
+static uint64_t mixLane(uint64_t lane, uint64_t input)
+{
+    lane += input * PRIME64_2;
+    lane = ROTATE(lane, 31);
+
+    return lane * PRIME64_1;
+}
+
+/**
+ * @brief fold a lane into the hash.
+ */
+static uint64_t mergeLane(uint64_t hash, uint64_t lane)
+{
+    hash ^= mixLane(0, lane);
+
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * @brief read a 64-bit word, in the native byte order.
+ */
+static uint64_t read64(const unsigned char *bytes)
+{
+    uint64_t word;
+
+    memcpy(&word, bytes, sizeof(word));
+
+    return word;
+}
+
+/**
+ * @brief read a 32-bit word, in the native byte order.
+ */
+static uint32_t read32(const unsigned char *bytes)
+{
+    uint32_t word;
+
+    memcpy(&word, bytes, sizeof(word));
+
+    return word;
+}
+
+/**
+ * @brief fill a buffer from a file, retrying short reads.
+ *
+ * @return size_t the bytes read, less than length only at the end of file
+ * or on failure.
+ */
+static size_t readFully(int fd, unsigned char *buffer, size_t length,
+                        off_t offset, bool *failed)
+{
+    size_t filled = 0;
+    ssize_t count;
+
+    while (filled < length)
+    {
+        count = pread(fd, buffer + filled, length - filled, offset + filled);
+
+        if (count == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            *failed = count == -1;
+            break;
+        }
+
+        filled += count;
+    }
+
+    return filled;
+}
+
+bool hashContent(int fd, off_t size, uint64_t *hash)
+{
+    uint64_t lanes[4] = {PRIME64_1 + PRIME64_2, PRIME64_2, 0, -PRIME64_1};
+    unsigned char *buffer, *at, *end;
+    uint64_t result;
+    off_t offset = 0;
+    size_t length = 0;
+    bool failed = false;
+    int i;
+
+    if (!(buffer = (unsigned char *)malloc(DEDUP_CHUNK)))
+    {
+        return false;
+    }
+
+    // every chunk but the last is a whole number of 32-byte stripes
+    while (offset < size)
+    {
+        length = readFully(fd, buffer, DEDUP_CHUNK, offset, &failed);
+        end = buffer + length - length % 32;
+
+        for (at = buffer; at < end; at += 32)
+        {
+            for (i = 0; i < 4; i++)
+            {
+                lanes[i] = mixLane(lanes[i], read64(at + 8 * i));
+            }
+        }
+
+        offset += length;
+
+        if (length < DEDUP_CHUNK)
+        {
+            break;
+        }
+    }
+
+    // a file that changed size while it was read can't be trusted
+    if (failed || offset != size)
+    {
+        free(buffer);
+        return false;
+    }
+
+    if (size >= 32)
+    {
+        result = ROTATE(lanes[0], 1) + ROTATE(lanes[1], 7) +
+                 ROTATE(lanes[2], 12) + ROTATE(lanes[3], 18);
+
+        for (i = 0; i < 4; i++)
+        {
+            result = mergeLane(result, lanes[i]);
+        }
+    }
+    else
+    {
+        result = PRIME64_5;
+    }
+
+    result += (uint64_t)size;
+
+    // the tail of the last chunk
+    at = buffer + length - length % 32;
+    end = buffer + length;
+
+    for (; at + 8 <= end; at += 8)
+    {
+        result ^= mixLane(0, read64(at));
+        result = ROTATE(result, 27) * PRIME64_1 + PRIME64_4;
+    }
+
+    if (at + 4 <= end)
+    {
+        result ^= (uint64_t)read32(at) * PRIME64_1;
+        result = ROTATE(result, 23) * PRIME64_2 + PRIME64_3;
+        at += 4;
+    }
+
+    for (; at < end; at++)
+    {
+        result ^= *at * PRIME64_5;
+        result = ROTATE(result, 11) * PRIME64_1;
+    }
+
+    result ^= result >> 33;
+    result *= PRIME64_2;
+    result ^= result >> 29;
+    result *= PRIME64_3;
+    result ^= result >> 32;
+
+    *hash = result;
+    free(buffer);
+
+    return true;
+}
+
+bool sameContent(int fd, int otherFd, off_t size)
+{
+    unsigned char *buffer, *other;
+    off_t offset = 0;
+    size_t length;
+    bool failed = false, same = true;
+
+    if (!(buffer = (unsigned char *)malloc(2 * DEDUP_CHUNK)))
+    {
+        return false;
+    }
+
+    other = buffer + DEDUP_CHUNK;
+
+    while (same && offset < size)
+    {
+        length = size - offset < DEDUP_CHUNK ? size - offset : DEDUP_CHUNK;
+        same = readFully(fd, buffer, length, offset, &failed) == length &&
+               readFully(otherFd, other, length, offset, &failed) == length &&
+               !memcmp(buffer, other, length);
+        offset += length;
+    }
+
+    free(buffer);
+
+    return same;
+}
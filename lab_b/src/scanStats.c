@@ -0,0 +1,186 @@
+/**
+ * counters of what the scans cost, kept per thread.
+ *
+ * every thread that scans gets counters of its own the first time it asks
+ * for them, and they are linked into a list so they can be summed once the
+ * scans are over. a thread only ever writes to its own, so counting takes
+ * no lock and no shared cache line: the lock is taken once per thread, to
+ * link its counters. a thread finds its counters through a key, along with
+ * the generation they belong to, so the counters of a previous set of
+ * viruses are never used again.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "../include/scanStats.h"
+
+// what a thread's key holds
+typedef struct statsSlot
+{
+    unsigned long long generation;
+    scanStats *stats;
+} statsSlot;
+
+static pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t slotKey;
+static pthread_mutex_t listLock = PTHREAD_MUTEX_INITIALIZER;
+static scanStats *threads = NULL; // the counters of every thread
+static unsigned long long generation = 0;
+static unsigned int counted = 0;  // viruses, 0 when nothing is counted
+
+static void createKey()
+{
+    pthread_key_create(&slotKey, free);
+}
+
+/**
+ * @brief allocate zeroed counters.
+ *
+ * @param stats the counters, zeroed.
+ * @param virusCount the number of viruses.
+ * @return true on success.
+ */
+static bool allocateStats(scanStats *stats, unsigned int virusCount)
+{
+    memset(stats, 0, sizeof(scanStats));
+
+    stats->virusCount = virusCount;
+    stats->hits = (unsigned long long *)calloc(virusCount,
+                                               sizeof(unsigned long long));
+    stats->attempts = (unsigned long long *)calloc(virusCount,
+                                                   sizeof(unsigned long long));
+
+    if (!stats->hits || !stats->attempts)
+    {
+        statsFree(stats);
+        return false;
+    }
+
+    return true;
+}
+
+void statsReset(unsigned int virusCount)
+{
+    statsStop();
+
+    pthread_once(&keyOnce, createKey);
+    counted = virusCount;
+}
+
+void statsStop()
+{
+    scanStats *stats;
+
+    pthread_mutex_lock(&listLock);
+
+    while ((stats = threads))
+    {
+        threads = stats->next;
+        statsFree(stats);
+        free(stats);
+    }
+
+    generation++;
+    counted = 0;
+
+    pthread_mutex_unlock(&listLock);
+}
+
+scanStats *statsThread()
+{
+    statsSlot *slot;
+    scanStats *stats;
+
+    if (!counted)
+    {
+        return NULL;
+    }
+
+    if (!(slot = (statsSlot *)pthread_getspecific(slotKey)))
+    {
+        if (!(slot = (statsSlot *)calloc(1, sizeof(statsSlot))) ||
+            pthread_setspecific(slotKey, slot))
+        {
+            free(slot);
+            return NULL;
+        }
+    }
+
+    if (slot->stats && slot->generation == generation)
+    {
+        return slot->stats;
+    }
+
+    // a thread that can't count is left out, and keeps trying
+    if (!(stats = (scanStats *)malloc(sizeof(scanStats))) ||
+        !allocateStats(stats, counted))
+    {
+        free(stats);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&listLock);
+    stats->next = threads;
+    threads = stats;
+    pthread_mutex_unlock(&listLock);
+
+    slot->generation = generation;
+    slot->stats = stats;
+
+    return stats;
+}
+
+const scanStats *statsList()
+{
+    return threads;
+}
+
+bool statsMerge(scanStats *total)
+{
+    scanStats *stats;
+    unsigned int i;
+
+    if (!counted || !allocateStats(total, counted))
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&listLock);
+
+    for (stats = threads; stats; stats = stats->next)
+    {
+        for (i = 0; i < total->virusCount; i++)
+        {
+            total->hits[i] += stats->hits[i];
+            total->attempts[i] += stats->attempts[i];
+        }
+
+        total->bytes += stats->bytes;
+        total->loadSeconds += stats->loadSeconds;
+        total->scanSeconds += stats->scanSeconds;
+        total->neutralizeSeconds += stats->neutralizeSeconds;
+    }
+
+    pthread_mutex_unlock(&listLock);
+
+    return true;
+}
+
+void statsFree(scanStats *total)
+{
+    free(total->hits);
+    free(total->attempts);
+    total->hits = NULL;
+    total->attempts = NULL;
+}
+
+double statsClock()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
@@ -0,0 +1,201 @@
+/**
+ * SHA-256, as in FIPS 180-4.
+ *
+ * whole blocks are compressed straight from the caller's buffer, only the
+ * bytes of a partial block are copied.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "../include/sha256.h"
+
+#define SHA256_READ (256 << 10) // read by sha256File at a time
+
+#define ROTATE(X, R) (((X) >> (R)) | ((X) << (32 - (R))))
+
+static const uint32_t ROUND_CONSTANTS[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/**
+ * @brief compress a block into the state.
+ *
+ * @param state the state.
+ * @param block 64 bytes of the message.
+ */
+static void compress(uint32_t state[8], const unsigned char *block)
+{
+    uint32_t schedule[64], working[8], first, second;
+    int i;
+
+    // the message words are big endian
+    for (i = 0; i < 16; i++)
+    {
+        schedule[i] = (uint32_t)block[4 * i] << 24 |
+                      (uint32_t)block[4 * i + 1] << 16 |
+                      (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+    }
+
+    for (i = 16; i < 64; i++)
+    {
+        first = ROTATE(schedule[i - 15], 7) ^ ROTATE(schedule[i - 15], 18) ^
+                (schedule[i - 15] >> 3);
+        second = ROTATE(schedule[i - 2], 17) ^ ROTATE(schedule[i - 2], 19) ^
+                 (schedule[i - 2] >> 10);
+        schedule[i] = schedule[i - 16] + first + schedule[i - 7] + second;
+    }
+
+    memcpy(working, state, sizeof(working));
+
+    // working holds a to h
+    for (i = 0; i < 64; i++)
+    {
+        first = working[7] +
+                (ROTATE(working[4], 6) ^ ROTATE(working[4], 11) ^
+                 ROTATE(working[4], 25)) +
+                ((working[4] & working[5]) ^ (~working[4] & working[6])) +
+                ROUND_CONSTANTS[i] + schedule[i];
+        second = (ROTATE(working[0], 2) ^ ROTATE(working[0], 13) ^
+                  ROTATE(working[0], 22)) +
+                 ((working[0] & working[1]) ^ (working[0] & working[2]) ^
+                  (working[1] & working[2]));
+
+        memmove(working + 1, working, 7 * sizeof(uint32_t));
+        working[4] += first;
+        working[0] = first + second;
+    }
+
+    for (i = 0; i < 8; i++)
+    {
+        state[i] += working[i];
+    }
+}
+
+void sha256Init(sha256Context *context)
+{
+    static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                        0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                        0x1f83d9ab, 0x5be0cd19};
+
+    memcpy(context->state, initial, sizeof(initial));
+    context->length = 0;
+    context->used = 0;
+}
+
+void sha256Update(sha256Context *context, const void *data, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t taken;
+
+    context->length += length;
+
+    // complete the partial block first
+    if (context->used)
+    {
+        taken = SHA256_BLOCK - context->used < length
+                    ? SHA256_BLOCK - context->used
+                    : length;
+        memcpy(context->block + context->used, bytes, taken);
+        context->used += taken;
+        bytes += taken;
+        length -= taken;
+
+        if (context->used < SHA256_BLOCK)
+        {
+            return;
+        }
+
+        compress(context->state, context->block);
+        context->used = 0;
+    }
+
+    for (; length >= SHA256_BLOCK;
+         bytes += SHA256_BLOCK, length -= SHA256_BLOCK)
+    {
+        compress(context->state, bytes);
+    }
+
+    memcpy(context->block, bytes, length);
+    context->used = length;
+}
+
+void sha256Final(sha256Context *context, unsigned char digest[SHA256_SIZE])
+{
+    uint64_t bits = context->length * 8;
+    int i;
+
+    // a 1 bit, zeros up to 8 bytes before a block ends, and the length
+    context->block[context->used++] = 0x80;
+
+    if (context->used > SHA256_BLOCK - 8)
+    {
+        memset(context->block + context->used, 0,
+               SHA256_BLOCK - context->used);
+        compress(context->state, context->block);
+        context->used = 0;
+    }
+
+    memset(context->block + context->used, 0,
+           SHA256_BLOCK - 8 - context->used);
+
+    for (i = 0; i < 8; i++)
+    {
+        context->block[SHA256_BLOCK - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    compress(context->state, context->block);
+
+    for (i = 0; i < 32; i++)
+    {
+        digest[i] =
+            (unsigned char)(context->state[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+bool sha256File(int fd, unsigned char digest[SHA256_SIZE])
+{
+    sha256Context context;
+    unsigned char *buffer;
+    off_t offset = 0;
+    ssize_t count;
+
+    if (!(buffer = (unsigned char *)malloc(SHA256_READ)))
+    {
+        return false;
+    }
+
+    sha256Init(&context);
+
+    while ((count = pread(fd, buffer, SHA256_READ, offset)) != 0)
+    {
+        if (count == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count == -1)
+        {
+            free(buffer);
+            return false;
+        }
+
+        sha256Update(&context, buffer, count);
+        offset += count;
+    }
+
+    sha256Final(&context, digest);
+    free(buffer);
+
+    return true;
+}
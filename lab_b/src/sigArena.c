@@ -0,0 +1,169 @@
+/**
+ * contiguous storage for the viruses.
+ *
+ * the records are appended to a single growing block while the signatures
+ * file is read. sealing the arena appends the indexes to the same block, so
+ * the whole set is released with a single free, and a compiled database can
+ * store the block as is.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "../include/sigArena.h"
+#include "../include/sigPattern.h"
+
+#define INITIAL_CAPACITY (4 << 10)
+#define ALIGN4(X) (((X) + 3) & ~(size_t)3)
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+virus *arenaAppend(sigArena *arena, unsigned short size)
+{
+    size_t recordSize = arenaRecordSize(size);
+    unsigned char *grown;
+    virus *vir;
+
+    if (arena->used + recordSize > arena->capacity)
+    {
+        arena->capacity = arena->capacity ? arena->capacity : INITIAL_CAPACITY;
+
+        while (arena->used + recordSize > arena->capacity)
+        {
+            arena->capacity *= 2;
+        }
+
+        if (!(grown = (unsigned char *)realloc(arena->block, arena->capacity)))
+        {
+            return NULL;
+        }
+
+        arena->block = grown;
+    }
+
+    vir = (virus *)(arena->block + arena->used);
+    memset(vir, 0, recordSize);
+    vir->SigSize = size;
+
+    arena->used += recordSize;
+    arena->count++;
+
+    return vir;
+}
+
+/**
+ * @brief order keys holding a first byte, a size and an index.
+ */
+static int compareKeys(const void *a, const void *b)
+{
+    uint64_t first = *(const uint64_t *)a, second = *(const uint64_t *)b;
+
+    return (first > second) - (first < second);
+}
+
+/**
+ * @brief sort the viruses with a signature by first byte and then by size,
+ * and record where every first byte's range starts. a pattern is sorted by
+ * its anchor, the bytes the automaton matches.
+ *
+ * @param arena an arena whose offsets are set.
+ * @return true on success.
+ */
+static bool buildIndex(sigArena *arena)
+{
+    uint64_t *keys = (uint64_t *)malloc((arena->count + 1) * sizeof(uint64_t));
+    unsigned int i, indexed = 0;
+    unsigned short length, offset;
+    const unsigned char *key;
+    int byte;
+
+    if (!keys)
+    {
+        return false;
+    }
+
+    for (i = 0; i < arena->count; i++)
+    {
+        key = virusKey(arenaVirus(arena, i), &length, &offset);
+
+        // the index keeps the list order of equal keys
+        if (length > 0)
+        {
+            keys[indexed++] = (uint64_t)key[0] << 48 | (uint64_t)length << 32 |
+                              i;
+        }
+    }
+
+    qsort(keys, indexed, sizeof(uint64_t), compareKeys);
+
+    memset(arena->bucketStart, 0, (ARENA_ALPHABET + 1) * sizeof(uint32_t));
+
+    for (i = 0; i < indexed; i++)
+    {
+        arena->byFirstByte[i] = (uint32_t)keys[i];
+        arena->bucketStart[(keys[i] >> 48) + 1]++;
+    }
+
+    for (byte = 0; byte < ARENA_ALPHABET; byte++)
+    {
+        arena->bucketStart[byte + 1] += arena->bucketStart[byte];
+    }
+
+    free(keys);
+
+    return true;
+}
+
+bool arenaSeal(sigArena *arena)
+{
+    size_t indexStart = ALIGN4(arena->used), position;
+    size_t size = indexStart + (2 * arena->count + ARENA_ALPHABET + 1) *
+                                   sizeof(uint32_t);
+    unsigned char *grown = (unsigned char *)realloc(arena->block, size);
+    virus *record;
+    unsigned int i;
+
+    if (!grown)
+    {
+        return false;
+    }
+
+    arena->block = grown;
+    arena->capacity = size;
+    arena->offsets = (uint32_t *)(arena->block + indexStart);
+    arena->byFirstByte = arena->offsets + arena->count;
+    arena->bucketStart = arena->byFirstByte + arena->count;
+
+    // the newest virus is the first in the list
+    for (i = arena->count, position = 0; i > 0; i--)
+    {
+        arena->offsets[i - 1] = position;
+        record = (virus *)(arena->block + position);
+        position += arenaRecordSize(record->SigSize);
+    }
+
+    return buildIndex(arena);
+}
+
+uint64_t arenaDigest(const sigArena *arena)
+{
+    uint64_t digest = FNV_OFFSET;
+    size_t i;
+
+    // FNV-1a, the records of a text file and of its database are the same
+    for (i = 0; i < arena->used; i++)
+    {
+        digest = (digest ^ arena->block[i]) * FNV_PRIME;
+    }
+
+    return digest;
+}
+
+void arenaFree(sigArena *arena)
+{
+    if (!arena->mapped)
+    {
+        free(arena->block);
+    }
+
+    memset(arena, 0, sizeof(sigArena));
+}
@@ -0,0 +1,273 @@
+/**
+ * compiled signatures databases.
+ *
+ * a database holds the arena of the viruses and the automaton built from
+ * them, laid out so the file can be mapped and used as is: loading it costs
+ * a mapping, with no parsing and no work at all per virus. the automaton is
+ * stored in the layout it was built with, a large database is sparse.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>    // for open
+#include <unistd.h>   // for close
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h> // for fstat
+#include "../include/sigDatabase.h"
+
+#define ALIGN(X) (((X) + 7) & ~(uint64_t)7)
+
+// the rows of transitions of an automaton, the root's alone in a sparse one
+#define DELTA_ROWS(LAYOUT, STATES) ((LAYOUT) == AC_LAYOUT_FULL ? (STATES) : 1)
+
+/**
+ * @brief write zeros up to an aligned offset.
+ *
+ * @param file an output stream.
+ * @param written the number of bytes written so far, updated.
+ * @return true on success.
+ */
+static bool writePadding(FILE *file, uint64_t *written)
+{
+    const char zeros[8] = {0};
+    size_t padding = ALIGN(*written) - *written;
+
+    *written += padding;
+
+    return fwrite(zeros, 1, padding, file) == padding;
+}
+
+/**
+ * @brief write a section and the padding after it.
+ *
+ * @param file an output stream.
+ * @param data the section's content.
+ * @param size the section's size.
+ * @param written the number of bytes written so far, updated.
+ * @return true on success.
+ */
+static bool writeSection(FILE *file, const void *data, size_t size,
+                         uint64_t *written)
+{
+    *written += size;
+
+    // an empty section may have no data at all
+    return (!size || fwrite(data, 1, size, file) == size) &&
+           writePadding(file, written);
+}
+
+bool dbCompile(const char *path, const acAutomaton *automaton)
+{
+    const sigArena *arena = automaton->arena;
+    unsigned int states = automaton->stateCount;
+    uint64_t written = 0, rows, nodes;
+    dbHeader header;
+    bool ok;
+    FILE *file;
+
+    if (automaton->engine != ENGINE_AUTOMATON)
+    {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(dbHeader));
+    memcpy(header.magic, DB_MAGIC, 4);
+    header.version = DB_VERSION;
+    header.byteOrder = DB_BYTE_ORDER;
+    header.virusCount = automaton->patternCount;
+    header.stateCount = states;
+    header.maxLength = automaton->maxLength;
+    header.layout = automaton->layout;
+    header.nodeSize = sizeof(acNode);
+    rows = DELTA_ROWS(automaton->layout, states);
+    nodes = automaton->layout == AC_LAYOUT_SPARSE ? states : 0;
+
+    // the arena's block is position independent, it is written as is
+    header.arenaOffset = ALIGN(sizeof(dbHeader));
+    header.arenaSize = arena->capacity;
+    header.recordsSize = arena->used;
+    header.offsetsOffset = (unsigned char *)arena->offsets - arena->block;
+    header.byFirstByteOffset = (unsigned char *)arena->byFirstByte -
+                               arena->block;
+    header.bucketStartOffset = (unsigned char *)arena->bucketStart -
+                               arena->block;
+
+    header.deltaOffset = ALIGN(header.arenaOffset + header.arenaSize);
+    header.nodesOffset = ALIGN(header.deltaOffset +
+                               rows * AC_ALPHABET * sizeof(int));
+    header.firstOutputOffset = ALIGN(header.nodesOffset +
+                                     nodes * sizeof(acNode));
+    header.nextOutputOffset = ALIGN(header.firstOutputOffset +
+                                    (uint64_t)states * sizeof(int));
+    header.dictLinkOffset = ALIGN(header.nextOutputOffset +
+                                  (uint64_t)header.virusCount * sizeof(int));
+    header.prefilterOffset = ALIGN(header.dictLinkOffset +
+                                   (uint64_t)states * sizeof(int));
+    header.fileSize = ALIGN(header.prefilterOffset + sizeof(acPrefilter));
+
+    if (!(file = fopen(path, "w")))
+    {
+        return false;
+    }
+
+    ok = writeSection(file, &header, sizeof(dbHeader), &written) &&
+         writeSection(file, arena->block, arena->capacity, &written) &&
+         writeSection(file, automaton->delta,
+                      (size_t)rows * AC_ALPHABET * sizeof(int), &written) &&
+         writeSection(file, automaton->nodes, (size_t)nodes * sizeof(acNode),
+                      &written) &&
+         writeSection(file, automaton->firstOutput, states * sizeof(int),
+                      &written) &&
+         writeSection(file, automaton->nextOutput,
+                      automaton->patternCount * sizeof(int), &written) &&
+         writeSection(file, automaton->dictLink, states * sizeof(int),
+                      &written) &&
+         writeSection(file, automaton->prefilter, sizeof(acPrefilter),
+                      &written);
+
+    if (fclose(file) == EOF)
+    {
+        ok = false;
+    }
+
+    return ok && written == header.fileSize;
+}
+
+/**
+ * @brief check that a header describes a database this build can use, and
+ * that all of its sections lie inside the file.
+ *
+ * @param header a header.
+ * @param size the size of the file.
+ * @return true if the header is valid.
+ */
+static bool validHeader(const dbHeader *header, uint64_t size)
+{
+    uint64_t count = header->virusCount, states = header->stateCount;
+    uint64_t rows = DELTA_ROWS(header->layout, states);
+    uint64_t nodes = header->layout == AC_LAYOUT_SPARSE ? states : 0;
+
+    return size >= sizeof(dbHeader) && !memcmp(header->magic, DB_MAGIC, 4) &&
+           header->version == DB_VERSION &&
+           header->byteOrder == DB_BYTE_ORDER && header->fileSize == size &&
+           header->layout < AC_LAYOUT_AUTO &&
+           header->nodeSize == sizeof(acNode) && states > 0 &&
+           header->recordsSize <= header->offsetsOffset &&
+           header->offsetsOffset + count * sizeof(uint32_t) <=
+               header->byFirstByteOffset &&
+           header->byFirstByteOffset + count * sizeof(uint32_t) <=
+               header->bucketStartOffset &&
+           header->bucketStartOffset +
+                   (ARENA_ALPHABET + 1) * sizeof(uint32_t) <=
+               header->arenaSize &&
+           header->arenaOffset + header->arenaSize <= header->deltaOffset &&
+           header->deltaOffset + rows * AC_ALPHABET * sizeof(int) <=
+               header->nodesOffset &&
+           header->nodesOffset + nodes * sizeof(acNode) <=
+               header->firstOutputOffset &&
+           header->firstOutputOffset + states * sizeof(int) <=
+               header->nextOutputOffset &&
+           header->nextOutputOffset + count * sizeof(int) <=
+               header->dictLinkOffset &&
+           header->dictLinkOffset + states * sizeof(int) <=
+               header->prefilterOffset &&
+           header->prefilterOffset + sizeof(acPrefilter) <= size;
+}
+
+sigDatabase *dbOpen(const char *path)
+{
+    sigDatabase *db = (sigDatabase *)calloc(1, sizeof(sigDatabase));
+    const dbHeader *header;
+    unsigned char *base;
+    struct stat info;
+    keyStats stats;
+    void *data;
+    int fd;
+
+    if (!db || (fd = open(path, O_RDONLY)) == -1)
+    {
+        free(db);
+        return NULL;
+    }
+
+    if (fstat(fd, &info) == -1 || (uintmax_t)info.st_size > SIZE_MAX ||
+        (size_t)info.st_size < sizeof(dbHeader) ||
+        (data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+            MAP_FAILED)
+    {
+        close(fd);
+        free(db);
+        return NULL;
+    }
+
+    close(fd);
+
+    db->base = data;
+    db->size = info.st_size;
+    base = (unsigned char *)data;
+    header = (const dbHeader *)base;
+
+    if (!validHeader(header, db->size))
+    {
+        dbClose(db);
+        return NULL;
+    }
+
+    // the records are trusted, the database is written by dbCompile
+    db->arena.block = base + header->arenaOffset;
+    db->arena.used = header->recordsSize;
+    db->arena.capacity = header->arenaSize;
+    db->arena.count = header->virusCount;
+    db->arena.offsets = (uint32_t *)(db->arena.block + header->offsetsOffset);
+    db->arena.byFirstByte = (uint32_t *)(db->arena.block +
+                                         header->byFirstByteOffset);
+    db->arena.bucketStart = (uint32_t *)(db->arena.block +
+                                         header->bucketStartOffset);
+    db->arena.mapped = true;
+
+    db->automaton.arena = &db->arena;
+    db->automaton.stateCount = header->stateCount;
+    db->automaton.patternCount = header->virusCount;
+    db->automaton.maxLength = header->maxLength;
+    db->automaton.layout = header->layout;
+    db->automaton.delta = (int *)(base + header->deltaOffset);
+    db->automaton.nodes = header->layout == AC_LAYOUT_SPARSE
+                              ? (acNode *)(base + header->nodesOffset)
+                              : NULL;
+    db->automaton.firstOutput = (int *)(base + header->firstOutputOffset);
+    db->automaton.nextOutput = (int *)(base + header->nextOutputOffset);
+    db->automaton.dictLink = (int *)(base + header->dictLinkOffset);
+    db->automaton.prefilter = (acPrefilter *)(base + header->prefilterOffset);
+
+    // the automaton is used unless another engine is forced, whose tables
+    // are built from the mapped arena
+    if (engineCurrent() == ENGINE_SHIFT || engineCurrent() == ENGINE_NAIVE)
+    {
+        keyStatsCollect(&stats, &db->arena);
+        db->automaton.engine = engineCurrent();
+
+        if (db->automaton.engine == ENGINE_SHIFT &&
+            !(db->automaton.shift = shiftBuild(&db->arena, &stats)))
+        {
+            dbClose(db);
+            return NULL;
+        }
+    }
+
+    return db;
+}
+
+void dbClose(sigDatabase *db)
+{
+    if (db)
+    {
+        if (db->base)
+        {
+            munmap(db->base, db->size);
+        }
+
+        shiftFree(db->automaton.shift);
+        free(db);
+    }
+}
@@ -0,0 +1,100 @@
+/**
+ * generations of loaded signatures.
+ *
+ * a new set of signatures is built while the scans go on with the current
+ * one, and then published by swapping a single pointer. every scan holds a
+ * reference to the generation it started with, so it reads the same viruses
+ * and automaton to its end, and a replaced generation is freed by whichever
+ * scan drops its last reference. the lock only covers reading the pointer
+ * and taking a reference, never a build or a scan.
+ */
+
+#include <stdlib.h>
+#include "../include/sigGeneration.h"
+
+sigGeneration *generationCreate(sigArena *viruses, acAutomaton *matcher,
+                                sigDatabase *database)
+{
+    sigGeneration *generation;
+
+    if (!(generation = (sigGeneration *)calloc(1, sizeof(sigGeneration))))
+    {
+        return NULL;
+    }
+
+    generation->viruses = *viruses;
+    generation->matcher = matcher;
+    generation->database = database;
+
+    // a loaded arena moves into the generation, and its matcher follows it
+    if (!database)
+    {
+        matcher->arena = &generation->viruses;
+    }
+
+    atomic_init(&generation->references, 1);
+
+    return generation;
+}
+
+void generationRelease(sigGeneration *generation)
+{
+    if (!generation || atomic_fetch_sub(&generation->references, 1) > 1)
+    {
+        return;
+    }
+
+    // the database's arena and automaton are in its mapping
+    if (generation->database)
+    {
+        dbClose(generation->database);
+    }
+    else
+    {
+        acFree(generation->matcher);
+        arenaFree(&generation->viruses);
+    }
+
+    free(generation);
+}
+
+void libraryInit(sigLibrary *library, sigGeneration *first)
+{
+    pthread_mutex_init(&library->lock, NULL);
+    library->current = first;
+    library->generations = 1;
+    first->number = 1;
+}
+
+sigGeneration *libraryAcquire(sigLibrary *library)
+{
+    sigGeneration *generation;
+
+    pthread_mutex_lock(&library->lock);
+    generation = library->current;
+    atomic_fetch_add(&generation->references, 1);
+    pthread_mutex_unlock(&library->lock);
+
+    return generation;
+}
+
+void libraryPublish(sigLibrary *library, sigGeneration *generation)
+{
+    sigGeneration *previous;
+
+    pthread_mutex_lock(&library->lock);
+    generation->number = ++library->generations;
+    previous = library->current;
+    library->current = generation;
+    pthread_mutex_unlock(&library->lock);
+
+    // the library's reference, the scans using it hold their own
+    generationRelease(previous);
+}
+
+void libraryFree(sigLibrary *library)
+{
+    generationRelease(library->current);
+    library->current = NULL;
+    pthread_mutex_destroy(&library->lock);
+}
@@ -0,0 +1,589 @@
+/**
+ * signatures with masked bytes and gaps.
+ *
+ * the automaton only matches the anchor of a pattern, an exact run of bytes
+ * at a fixed offset from its first byte. where the anchor is found, the
+ * whole pattern is checked from that first byte by advancing the set of
+ * offsets every element can be reached at, one element at a time, so no
+ * offset is ever tried twice for the same element and nothing is undone.
+ *
+ * that check costs up to the span times the gap per element, and a text
+ * made of the anchor repeated has a candidate at every byte, so a check
+ * that takes more than a few steps per element is left undecided. the
+ * undecided candidates of a pattern are checked together once the buffer
+ * is scanned, working back from the last element: an offset is marked if
+ * the element matches there and the next element is marked within its
+ * gap, which a count of the marks in a window sliding along the offsets
+ * tells in constant time. a candidate matches if its first byte is marked,
+ * and every byte costs a step per element, however many candidates share
+ * it.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "../include/sigPattern.h"
+
+#define HEX_DIGITS "0123456789abcdef"
+
+// the offsets 0 to PATTERN_MAX_SPAN, a bit each
+#define REACH_WORDS (PATTERN_MAX_SPAN / 64 + 1)
+
+// the marks of a run's offsets, and of those a gap reaches past them
+#define MARKS_SIZE (PATTERN_BATCH + PATTERN_MAX_SPAN + PATTERN_MAX_GAP + 2)
+
+/**
+ * @brief parse a hex digit, or ? for any nibble.
+ *
+ * @param c a character.
+ * @param nibble the value of the digit.
+ * @param mask 0xf for a digit, 0 for ?.
+ * @return true if c is a digit or ?.
+ */
+static bool parseNibble(char c, unsigned char *nibble, unsigned char *mask)
+{
+    const char *digit;
+
+    if (c == '?')
+    {
+        *nibble = 0;
+        *mask = 0;
+        return true;
+    }
+
+    if (!c || !(digit = strchr(HEX_DIGITS, tolower((unsigned char)c))))
+    {
+        return false;
+    }
+
+    *nibble = digit - HEX_DIGITS;
+    *mask = 0xf;
+
+    return true;
+}
+
+/**
+ * @brief parse a decimal number of a gap.
+ *
+ * @param text the text.
+ * @param length its length.
+ * @param i the position of the number, advanced past it.
+ * @param number the number.
+ * @return true if there were digits and the number is a valid gap.
+ */
+static bool parseNumber(const char *text, size_t length, size_t *i,
+                        unsigned int *number)
+{
+    size_t start = *i;
+
+    for (*number = 0; *i < length && isdigit((unsigned char)text[*i]); (*i)++)
+    {
+        *number = *number * 10 + (text[*i] - '0');
+
+        if (*number > PATTERN_MAX_GAP)
+        {
+            return false;
+        }
+    }
+
+    return *i > start;
+}
+
+/**
+ * @brief parse a gap of {N}, {N-M} or {-M} bytes.
+ *
+ * @param text the text.
+ * @param length its length.
+ * @param i the position of the opening brace, advanced past the gap.
+ * @param gapMin the fewest bytes of the gap.
+ * @param gapMax the most bytes of the gap.
+ * @return true if the gap is valid.
+ */
+static bool parseGap(const char *text, size_t length, size_t *i,
+                     unsigned int *gapMin, unsigned int *gapMax)
+{
+    (*i)++;
+    *gapMin = 0;
+
+    if (*i < length && text[*i] != '-' &&
+        !parseNumber(text, length, i, gapMin))
+    {
+        return false;
+    }
+
+    *gapMax = *gapMin;
+
+    if (*i < length && text[*i] == '-')
+    {
+        (*i)++;
+
+        if (!parseNumber(text, length, i, gapMax) || *gapMax < *gapMin)
+        {
+            return false;
+        }
+    }
+
+    return *i < length && text[(*i)++] == '}';
+}
+
+/**
+ * @brief find the longest run of exact bytes before the first gap of
+ * variable size, and append its bytes after the elements.
+ *
+ * @param pattern a pattern whose elements are set.
+ * @return true if the pattern has an exact byte there.
+ */
+static bool chooseAnchor(sigPattern *pattern)
+{
+    const patternElement *element;
+    unsigned short offset = 0, runStart = 0, runOffset = 0, runLength = 0;
+    unsigned short anchorElement = 0;
+    unsigned char *anchor;
+    unsigned int i;
+
+    pattern->anchorLength = 0;
+
+    for (i = 0; i < pattern->elementCount; i++)
+    {
+        element = &pattern->elements[i];
+
+        if (element->gapMin != element->gapMax)
+        {
+            break;
+        }
+
+        offset += element->gapMin;
+
+        if (element->mask != 0xff)
+        {
+            runLength = 0;
+        }
+        else
+        {
+            if (runLength == 0 || element->gapMin > 0)
+            {
+                runStart = i;
+                runOffset = offset;
+                runLength = 0;
+            }
+
+            if (++runLength > pattern->anchorLength)
+            {
+                anchorElement = runStart;
+                pattern->anchorOffset = runOffset;
+                pattern->anchorLength = runLength;
+            }
+        }
+
+        offset++;
+    }
+
+    anchor = (unsigned char *)patternAnchor(pattern);
+
+    for (i = 0; i < pattern->anchorLength; i++)
+    {
+        anchor[i] = pattern->elements[anchorElement + i].value;
+    }
+
+    return pattern->anchorLength > 0;
+}
+
+size_t patternCompile(const char *text, size_t length,
+                      unsigned char *compiled)
+{
+    sigPattern *pattern = (sigPattern *)compiled;
+    patternElement *element;
+    unsigned char high, low, highMask, lowMask;
+    unsigned int gapMin = 0, gapMax = 0, addedMin, addedMax;
+    unsigned int minSpan = 0, maxSpan = 0;
+    size_t i = 0;
+
+    memset(pattern, 0, sizeof(sigPattern));
+
+    while (i < length)
+    {
+        if (isspace((unsigned char)text[i]))
+        {
+            i++;
+        }
+        else if (text[i] == '{')
+        {
+            // a gap leads nowhere before the first byte
+            if (pattern->elementCount == 0 ||
+                !parseGap(text, length, &i, &addedMin, &addedMax) ||
+                (gapMax += addedMax) > PATTERN_MAX_GAP)
+            {
+                return 0;
+            }
+
+            gapMin += addedMin;
+        }
+        else
+        {
+            if (i + 1 >= length || !parseNibble(text[i], &high, &highMask) ||
+                !parseNibble(text[i + 1], &low, &lowMask) ||
+                (maxSpan += gapMax + 1) > PATTERN_MAX_SPAN)
+            {
+                return 0;
+            }
+
+            minSpan += gapMin + 1;
+
+            element = &pattern->elements[pattern->elementCount++];
+            element->value = high << 4 | low;
+            element->mask = highMask << 4 | lowMask;
+            element->gapMin = gapMin;
+            element->gapMax = gapMax;
+
+            gapMin = gapMax = 0;
+            i += 2;
+        }
+    }
+
+    // nor after the last one
+    if (gapMax > 0 || !chooseAnchor(pattern))
+    {
+        return 0;
+    }
+
+    pattern->minSpan = minSpan;
+    pattern->maxSpan = maxSpan;
+
+    return sizeof(sigPattern) +
+           pattern->elementCount * sizeof(patternElement) +
+           pattern->anchorLength;
+}
+
+patternResult patternMatch(const sigPattern *pattern,
+                           const unsigned char *buffer, size_t size)
+{
+    // reach[current] has bit p set if the element can be matched after p
+    // bytes
+    uint64_t reach[2][REACH_WORDS];
+    const patternElement *element;
+    size_t steps = (size_t)PATTERN_STEPS * pattern->elementCount;
+    size_t low = 0, high = 0, nextLow, nextHigh, word, first, p, q, last;
+    uint64_t bits;
+    unsigned int i;
+    int current = 0;
+
+    // only the words an element's matches may be marked in are cleared
+    reach[0][0] = 1;
+
+    for (i = 0; i < pattern->elementCount; i++)
+    {
+        element = &pattern->elements[i];
+        nextLow = PATTERN_MAX_SPAN + 1;
+        nextHigh = 0;
+        first = (low + element->gapMin + 1) / 64;
+        memset(reach[!current] + first, 0,
+               ((high + element->gapMax + 1) / 64 - first + 1) *
+                   sizeof(uint64_t));
+
+        for (word = low / 64; word <= high / 64; word++)
+        {
+            for (bits = reach[current][word]; bits; bits &= bits - 1)
+            {
+                p = word * 64 + __builtin_ctzll(bits);
+                last = p + element->gapMax;
+
+                for (q = p + element->gapMin; q <= last && q < size; q++)
+                {
+                    if (!steps--)
+                    {
+                        return PATTERN_UNDECIDED;
+                    }
+
+                    if ((buffer[q] & element->mask) == element->value)
+                    {
+                        reach[!current][(q + 1) / 64] |= 1ULL << (q + 1) % 64;
+                        nextLow = q + 1 < nextLow ? q + 1 : nextLow;
+                        nextHigh = q + 1 > nextHigh ? q + 1 : nextHigh;
+                    }
+                }
+            }
+        }
+
+        if (nextHigh == 0)
+        {
+            return PATTERN_MISMATCH;
+        }
+
+        current = !current;
+        low = nextLow;
+        high = nextHigh;
+    }
+
+    return PATTERN_MATCH;
+}
+
+/**
+ * @brief order candidates by virus and then by offset.
+ */
+static int compareCandidates(const void *a, const void *b)
+{
+    const scanHit *first = (const scanHit *)a, *second = (const scanHit *)b;
+
+    if (first->virusIndex != second->virusIndex)
+    {
+        return first->virusIndex < second->virusIndex ? -1 : 1;
+    }
+
+    return (first->offset > second->offset) - (first->offset < second->offset);
+}
+
+/**
+ * @brief sort candidates by virus and then by offset.
+ *
+ * each engine finds the candidates of a pattern in the order of their
+ * offsets, so they are spread by virus keeping that order, and sorted in
+ * full only if it wasn't kept.
+ *
+ * @param arena the arena of the viruses.
+ * @param candidates the candidates.
+ * @return false if the memory couldn't be allocated.
+ */
+static bool sortCandidates(const sigArena *arena, hitBuffer *candidates)
+{
+    size_t *start;
+    scanHit *sorted;
+    size_t i, total;
+    unsigned int v;
+
+    start = (size_t *)calloc((size_t)arena->count + 1, sizeof(size_t));
+    sorted = (scanHit *)malloc(candidates->count * sizeof(scanHit));
+
+    if (!start || !sorted)
+    {
+        free(start);
+        free(sorted);
+        return false;
+    }
+
+    for (i = 0; i < candidates->count; i++)
+    {
+        start[candidates->hits[i].virusIndex + 1]++;
+    }
+
+    for (v = 0, total = 0; v <= arena->count; v++)
+    {
+        total += start[v];
+        start[v] = total;
+    }
+
+    for (i = 0; i < candidates->count; i++)
+    {
+        sorted[start[candidates->hits[i].virusIndex]++] = candidates->hits[i];
+    }
+
+    memcpy(candidates->hits, sorted, candidates->count * sizeof(scanHit));
+    free(sorted);
+    free(start);
+
+    for (i = 1; i < candidates->count; i++)
+    {
+        if (compareCandidates(&candidates->hits[i - 1],
+                              &candidates->hits[i]) > 0)
+        {
+            qsort(candidates->hits, candidates->count, sizeof(scanHit),
+                  compareCandidates);
+            break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief check a run of candidates of a pattern together.
+ *
+ * @param pattern the pattern.
+ * @param index its virus.
+ * @param buffer the scanned buffer.
+ * @param size its size.
+ * @param run candidates of the pattern sorted by offset, the first and the
+ * last PATTERN_BATCH bytes apart at most.
+ * @param count their number.
+ * @param marks two buffers of MARKS_SIZE bytes.
+ * @param hits receives the candidates that match.
+ * @return false if the hits couldn't grow.
+ */
+static bool resolveRun(const sigPattern *pattern, unsigned int index,
+                       const unsigned char *buffer, size_t size,
+                       const scanHit *run, size_t count,
+                       unsigned char *marks[2], hitBuffer *hits)
+{
+    const patternElement *element;
+    size_t low = run[0].offset, last = run[count - 1].offset;
+    size_t high = last + pattern->maxSpan < size ? last + pattern->maxSpan
+                                                 : size;
+    size_t minOffset = pattern->minSpan - 1, maxOffset = pattern->maxSpan - 1;
+    size_t from, to = 0, gapMin = 0, gapMax = 0, q, i;
+    unsigned char *current = marks[0], *next = marks[1], *swap;
+    unsigned int reached;
+    int j;
+
+    // the offsets an element can be at are those of the run's first bytes
+    // moved by the shortest and the longest distance to it. the next
+    // element's offsets start right where its gap from them does, and its
+    // marks are 0 past the last one
+    for (j = pattern->elementCount - 1; j >= 0; j--)
+    {
+        element = &pattern->elements[j];
+        from = low + minOffset;
+        to = last + maxOffset + 1 < high ? last + maxOffset + 1 : high;
+
+        if (from >= to)
+        {
+            return true;
+        }
+
+        if (j == pattern->elementCount - 1)
+        {
+            for (q = from; q < to; q++)
+            {
+                current[q - low] =
+                    (buffer[q] & element->mask) == element->value;
+            }
+        }
+        else
+        {
+            for (reached = 0, q = to + 1 + gapMin; q <= to + 1 + gapMax;
+                 q++)
+            {
+                reached += next[q - low];
+            }
+
+            // the window is slid back an offset at a time
+            for (q = to; q-- > from;)
+            {
+                reached += next[q + 1 + gapMin - low];
+                reached -= next[q + 2 + gapMax - low];
+
+                current[q - low] =
+                    reached && (buffer[q] & element->mask) == element->value;
+            }
+        }
+
+        gapMin = element->gapMin;
+        gapMax = element->gapMax;
+        memset(current + (to - low), 0, gapMax + 2);
+        minOffset -= 1 + gapMin;
+        maxOffset -= 1 + gapMax;
+
+        swap = current;
+        current = next;
+        next = swap;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if ((i == 0 || run[i].offset != run[i - 1].offset) &&
+            run[i].offset < to && next[run[i].offset - low] &&
+            !hitAppend(hits, index, run[i].offset))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool patternResolve(const sigArena *arena, const unsigned char *buffer,
+                    size_t size, hitBuffer *candidates, hitBuffer *hits)
+{
+    const sigPattern *pattern;
+    const scanHit *run;
+    unsigned char *marks[2];
+    size_t i, count;
+    bool ok = true;
+
+    if (candidates->count == 0)
+    {
+        return true;
+    }
+
+    if (!sortCandidates(arena, candidates))
+    {
+        return false;
+    }
+
+    if (!(marks[0] = (unsigned char *)malloc(2 * MARKS_SIZE)))
+    {
+        return false;
+    }
+
+    marks[1] = marks[0] + MARKS_SIZE;
+
+    // a run ends where the span of its last candidate does, or where it
+    // would outgrow the buffers of marks
+    for (i = 0; i < candidates->count && ok; i += count)
+    {
+        run = candidates->hits + i;
+        pattern = virusPattern(arenaVirus(arena, run->virusIndex));
+
+        for (count = 1;
+             i + count < candidates->count &&
+             run[count].virusIndex == run->virusIndex &&
+             run[count].offset - run->offset < PATTERN_BATCH &&
+             run[count].offset - run[count - 1].offset < pattern->maxSpan;
+             count++)
+        {
+        }
+
+        ok = resolveRun(pattern, run->virusIndex, buffer, size, run, count,
+                        marks, hits);
+    }
+
+    free(marks[0]);
+
+    return ok;
+}
+
+void patternPrint(FILE *file, const sigPattern *pattern)
+{
+    const patternElement *element;
+    unsigned int i;
+
+    for (i = 0; i < pattern->elementCount; i++)
+    {
+        element = &pattern->elements[i];
+
+        if (element->gapMin != element->gapMax)
+        {
+            fprintf(file, "{%d-%d} ", element->gapMin, element->gapMax);
+        }
+        else if (element->gapMax > 0)
+        {
+            fprintf(file, "{%d} ", element->gapMax);
+        }
+
+        fprintf(file, "%c%c ",
+                element->mask & 0xf0 ? HEX_DIGITS[element->value >> 4] : '?',
+                element->mask & 0x0f ? HEX_DIGITS[element->value & 0xf] : '?');
+    }
+}
+
+const unsigned char *virusKey(const virus *vir, unsigned short *length,
+                              unsigned short *offset)
+{
+    if (vir->SigSize & SIG_PATTERN)
+    {
+        *length = virusPattern(vir)->anchorLength;
+        *offset = virusPattern(vir)->anchorOffset;
+
+        return patternAnchor(virusPattern(vir));
+    }
+
+    *length = vir->SigSize;
+    *offset = 0;
+
+    return vir->sig;
+}
+
+unsigned short virusLength(const virus *vir)
+{
+    return vir->SigSize & SIG_PATTERN ? virusPattern(vir)->minSpan
+                                      : vir->SigSize;
+}
@@ -0,0 +1,426 @@
+/**
+ * a constant-memory scan over streams of any size.
+ *
+ * the stream is scanned one window at a time. hits are reported by the
+ * window that holds their first byte before the carried-over tail, so every
+ * hit is reported exactly once, in the order of its offset.
+ *
+ * files are read one data extent at a time, as reported by SEEK_DATA and
+ * SEEK_HOLE, and the holes between them are skipped rather than read.
+ * pipes and other unseekable streams are read as they come, and may be
+ * copied somewhere else on the way.
+ */
+
+#define _GNU_SOURCE   // for SEEK_DATA and SEEK_HOLE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>   // for ULLONG_MAX
+#include <sys/stat.h> // for fstat
+#include "../include/streamScan.h"
+
+bool streamInit(scanStream *stream, const acAutomaton *matcher,
+                size_t chunkSize, hitHandler onHit, void *context)
+{
+    memset(stream, 0, sizeof(scanStream));
+
+    stream->matcher = matcher;
+    stream->chunkSize = chunkSize;
+    stream->end = ULLONG_MAX;
+    stream->overlap = matcher->maxLength > 0 ? matcher->maxLength - 1 : 0;
+    stream->onHit = onHit;
+    stream->context = context;
+    stream->window = (unsigned char *)malloc(stream->overlap + chunkSize);
+
+    return stream->window != NULL;
+}
+
+/**
+ * @brief scan the filled part of the window and report the hits starting
+ * before the boundary and the end of the stream's range, and count them.
+ *
+ * @param stream a stream.
+ * @param boundary window offset of the first byte that is not final yet.
+ */
+static void scanWindow(scanStream *stream, size_t boundary)
+{
+    scanStats *stats = statsThread();
+    scanHit *hits;
+    size_t count, i;
+
+    hitClear(&stream->hits);
+    count = acScan(stream->matcher, stream->window, stream->filled,
+                   &stream->hits);
+    hits = stream->hits.hits;
+
+    for (i = 0; i < count && hits[i].offset < boundary &&
+                stream->base + hits[i].offset < stream->end;
+         i++)
+    {
+        statsHit(stats, hits[i].virusIndex);
+        stream->onHit(stream->context, hits[i].virusIndex,
+                      stream->base + hits[i].offset);
+    }
+}
+
+unsigned char *streamSpace(scanStream *stream, size_t *available)
+{
+    *available = stream->overlap + stream->chunkSize - stream->filled;
+
+    return stream->window + stream->filled;
+}
+
+void streamCommit(scanStream *stream, size_t count)
+{
+    size_t boundary;
+
+    stream->filled += count;
+
+    if (stream->filled == stream->overlap + stream->chunkSize)
+    {
+        // a signature starting in the tail may continue in the next chunk
+        boundary = stream->filled - stream->overlap;
+
+        scanWindow(stream, boundary);
+
+        memmove(stream->window, stream->window + boundary, stream->overlap);
+        stream->base += boundary;
+        stream->filled = stream->overlap;
+    }
+}
+
+void streamFeed(scanStream *stream, const unsigned char *data, size_t size)
+{
+    unsigned char *space;
+    size_t available;
+
+    while (size > 0)
+    {
+        space = streamSpace(stream, &available);
+
+        if (available > size)
+        {
+            available = size;
+        }
+
+        memcpy(space, data, available);
+        streamCommit(stream, available);
+
+        data += available;
+        size -= available;
+    }
+}
+
+/**
+ * @brief feed zero bytes to the stream.
+ *
+ * @param stream a stream.
+ * @param length the number of zeros.
+ */
+static void feedZeros(scanStream *stream, unsigned long long length)
+{
+    unsigned char *space;
+    size_t available;
+
+    while (length > 0)
+    {
+        space = streamSpace(stream, &available);
+
+        if (available > length)
+        {
+            available = length;
+        }
+
+        memset(space, 0, available);
+        streamCommit(stream, available);
+
+        length -= available;
+    }
+}
+
+void streamSkip(scanStream *stream, unsigned long long length)
+{
+    unsigned long long margin = stream->overlap;
+
+    if (length <= 2 * margin)
+    {
+        feedZeros(stream, length);
+        return;
+    }
+
+    // the signatures ending in the hole and the ones starting in it
+    feedZeros(stream, margin);
+    streamFinish(stream);
+
+    stream->base += length - 2 * margin;
+    feedZeros(stream, margin);
+}
+
+void streamFinish(scanStream *stream)
+{
+    // hits in the tail were not reported by the last full window
+    scanWindow(stream, stream->filled);
+
+    stream->base += stream->filled;
+    stream->filled = 0;
+}
+
+void streamFree(scanStream *stream)
+{
+    free(stream->window);
+    hitFree(&stream->hits);
+
+    stream->window = NULL;
+}
+
+/**
+ * @brief read a range of a file into the stream.
+ *
+ * @param stream a stream.
+ * @param fd a seekable file.
+ * @param position the start of the range.
+ * @param end the end of the range.
+ * @return off_t where the reading stopped, before end at the end of the
+ * file, or -1 on a read error.
+ */
+static off_t readRange(scanStream *stream, int fd, off_t position, off_t end)
+{
+    unsigned char *space;
+    size_t available;
+    ssize_t bytesRead;
+
+    while (position < end)
+    {
+        space = streamSpace(stream, &available);
+
+        if ((off_t)available > end - position)
+        {
+            available = end - position;
+        }
+
+        bytesRead = pread(fd, space, available, position);
+
+        if (bytesRead > 0)
+        {
+            streamCommit(stream, bytesRead);
+            position += bytesRead;
+        }
+        else if (bytesRead == 0)
+        {
+            break;
+        }
+        else if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+
+    return position;
+}
+
+void streamExtent(int fd, off_t position, off_t end, bool *sparse,
+                  off_t *data, off_t *hole)
+{
+    *data = *sparse ? lseek(fd, position, SEEK_DATA) : position;
+
+    if (*data == -1 && errno == ENXIO)
+    {
+        // nothing but a hole up to the end of the file
+        *data = end;
+    }
+    else if (*data == -1)
+    {
+        *sparse = false;
+        *data = position;
+    }
+
+    *data = *data < end ? *data : end;
+    *hole = *sparse && *data < end ? lseek(fd, *data, SEEK_HOLE) : end;
+    *hole = *hole != -1 && *hole < end ? *hole : end;
+}
+
+/**
+ * @brief read a range of a file into the stream one data extent at a time,
+ * skipping the holes. without SEEK_DATA support, the whole range is read.
+ *
+ * @param stream a stream.
+ * @param fd a seekable file.
+ * @param position the start of the range.
+ * @param end the end of the range.
+ * @return true on success.
+ */
+static bool readExtents(scanStream *stream, int fd, off_t position, off_t end)
+{
+    bool sparse = true;
+    off_t data, hole, reached;
+
+    while (position < end)
+    {
+        streamExtent(fd, position, end, &sparse, &data, &hole);
+        streamSkip(stream, data - position);
+
+        if ((reached = readRange(stream, fd, data, hole)) == -1)
+        {
+            return false;
+        }
+
+        // the file was cut while it was scanned
+        if (reached < hole)
+        {
+            break;
+        }
+
+        position = hole;
+    }
+
+    return true;
+}
+
+/**
+ * @brief write all of a buffer, however many writes it takes.
+ *
+ * @param fd a descriptor.
+ * @param data the bytes.
+ * @param size how many.
+ * @return true on success.
+ */
+static bool writeAll(int fd, const unsigned char *data, size_t size)
+{
+    ssize_t written;
+
+    while (size > 0)
+    {
+        if ((written = write(fd, data, size)) == -1)
+        {
+            if (errno != EINTR)
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        data += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+/**
+ * @brief read an unseekable stream into the stream until its end, copying
+ * every byte read to another descriptor before it is scanned.
+ *
+ * @param stream a stream.
+ * @param fd the descriptor to read.
+ * @param copy the descriptor to copy to, or -1.
+ * @return true if the end was reached and every byte was copied.
+ */
+static bool readStream(scanStream *stream, int fd, int copy)
+{
+    unsigned char *space;
+    size_t available;
+    ssize_t bytesRead;
+
+    do
+    {
+        space = streamSpace(stream, &available);
+
+        if ((bytesRead = read(fd, space, available)) > 0)
+        {
+            // a full window moves once committed
+            if (copy != -1 && !writeAll(copy, space, bytesRead))
+            {
+                return false;
+            }
+
+            streamCommit(stream, bytesRead);
+        }
+    } while (bytesRead > 0 || (bytesRead == -1 && errno == EINTR));
+
+    return bytesRead == 0;
+}
+
+bool streamScanFd(int fd, const acAutomaton *matcher, hitHandler onHit,
+                  void *context)
+{
+    scanStream stream;
+    struct stat info;
+    off_t start;
+    bool ok;
+
+    if (!streamInit(&stream, matcher, STREAM_CHUNK, onHit, context))
+    {
+        return false;
+    }
+
+    // only a regular file has holes, anything else is read as a stream
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+        (start = lseek(fd, 0, SEEK_CUR)) != -1)
+    {
+        ok = readExtents(&stream, fd, start, info.st_size);
+    }
+    else
+    {
+        ok = readStream(&stream, fd, -1);
+    }
+
+    streamFinish(&stream);
+    streamFree(&stream);
+
+    return ok;
+}
+
+bool streamScanPipe(int fd, int copy, const acAutomaton *matcher,
+                    hitHandler onHit, void *context)
+{
+    scanStream stream;
+    bool ok;
+
+    if (!streamInit(&stream, matcher, STREAM_CHUNK, onHit, context))
+    {
+        return false;
+    }
+
+    ok = readStream(&stream, fd, copy);
+
+    // what was read before a failure is still scanned
+    streamFinish(&stream);
+    streamFree(&stream);
+
+    return ok;
+}
+
+bool streamScanRange(int fd, off_t start, off_t end,
+                     const acAutomaton *matcher, hitHandler onHit,
+                     void *context)
+{
+    scanStream stream;
+    struct stat info;
+    off_t last;
+    bool ok;
+
+    if (!streamInit(&stream, matcher, STREAM_CHUNK, onHit, context))
+    {
+        return false;
+    }
+
+    // offsets are relative to the file, not to the range, and the hits past
+    // it belong to the next range
+    stream.base = start;
+    stream.end = end;
+    last = end + stream.overlap;
+
+    if (fstat(fd, &info) == 0 && info.st_size < last)
+    {
+        last = info.st_size;
+    }
+
+    ok = readExtents(&stream, fd, start, last);
+
+    streamFinish(&stream);
+    streamFree(&stream);
+
+    return ok;
+}
@@ -2,15 +2,171 @@
 NAME
     virusDetector - detects a virus in a file from a given set of viruses.
 SYNOPSIS
-    virusDetector FILE.
+    virusDetector [-FILE FILE] [-mmap | -pipeline DEPTH [-chunk KILOBYTES]]
+                  [-elf] [-engine ENGINE] [-layout LAYOUT] [-stats]
+                  [-format FORMAT] [-report REPORT]
+    virusDetector -r DIR [-j THREADS] [-sigs SIGFILE] [-cache CACHE [-rescan]]
+                  [-dedup] [-hashes BLOCKLIST] [-stats]
+                  [-format FORMAT] [-report REPORT]
+    virusDetector -watch DIR [-watch DIR]... [-j THREADS] [-sigs SIGFILE]
+                  [-stats] [-format FORMAT] [-report REPORT]
+    virusDetector -stream SOURCE [-passthrough] [-sigs SIGFILE] [-stats]
+                  [-format FORMAT] [-report REPORT]
+    virusDetector -daemon SOCKET [-j THREADS] [-sigs SIGFILE]
+    virusDetector -compile DATABASE [-sigs SIGFILE] [-layout LAYOUT]
+    virusDetector -compilehashes OUTPUT -hashes BLOCKLIST
+    virusDetector -bench SAMPLE MEGABYTES [-sigs SIGFILE]
+    virusDetector -benchscan FILE [-sigs SIGFILE]
 DESCRIPTION
     virusDetector compares the content of the given FILE byte-by-byte with a
-    pre-defined set of viruses described in the file. The comparison is done
-    according to a naive algorithm described in task 2.
+    pre-defined set of viruses described in the file. The signatures are
+    compiled into an Aho-Corasick automaton when they are loaded, so the file
+    is scanned for all of them in a single pass. Files of any size are scanned
+    in fixed-size chunks, so the memory used does not depend on the file.
+    The holes of sparse files are skipped instead of read, on file systems
+    that report them.
+    A signature whose size has the 0x8000 bit set is a pattern: the rest of
+    the size is the length of its text, hex pairs where ? matches any nibble,
+    and gaps of {N}, {N-M} or {-M} bytes between them, e.g. "e8 ?? 4? {2-8}
+    c3". A pattern needs an exact byte before its first gap of variable size,
+    and it is reported with the size of its shortest match.
     FILE - the suspected file.
+    -mmap - map FILE into memory once, and detect and fix the viruses directly
+    in the mapping instead of reading the file into buffers.
+    -pipeline DEPTH - read FILE on a thread of its own, into a ring of DEPTH
+    chunks of KILOBYTES each (64 by default), while the chunks already read
+    are scanned. The time each side waited for the other is printed after
+    every scan.
+    -elf - if FILE is an ELF file, detect viruses only in its executable
+    sections, or in its executable loadable segments if it has no section
+    headers, and report them as SECTION+OFFSET. The bytes scanned out of the
+    whole file are printed after every scan. Other files are scanned whole.
+    -r DIR - scan every regular file under DIR without the menu, using a pool
+    of THREADS threads (one per processor by default). The results of every
+    file are printed in name order.
+    -cache CACHE - keep the verdicts of the sweep in CACHE. Files that were
+    clean and whose size, modification and status change times haven't
+    changed since are skipped, unless the signatures have changed. Infected
+    files are always scanned again to print their viruses. The files the
+    sweep doesn't see are dropped from CACHE, so it should be kept for a
+    single DIR.
+    -rescan - scan every file, ignoring the verdicts in CACHE, and record
+    the new ones.
+    -dedup - scan identical files once. A hard link to a file seen before is
+    recognized by its inode without being read. Files that have the size of
+    another file are hashed (XXH64), and a file with the size and hash of
+    one seen before is compared with it byte by byte, and isn't scanned if
+    they are the same. Either is reported with the verdict and the viruses
+    of the first file. How many files were hashed and reused a
+    verdict is printed at the end.
+    -hashes BLOCKLIST - look up the SHA-256 of FILE, or of every file of the
+    sweep, in BLOCKLIST, a file with a digest in hex at the start of every
+    line (as printed by sha256sum), or one compiled with -compilehashes. A
+    listed file is reported with a "known bad sha256" line, and isn't
+    scanned by the sweep. The lookup takes the same time whatever the size
+    of BLOCKLIST, which takes about 33 bytes of memory per digest. A line
+    of BLOCKLIST that isn't a digest is reported as FILE:LINE on stderr and
+    skipped, the others are still loaded.
+    -compilehashes OUTPUT - write BLOCKLIST sorted and without duplicates
+    into OUTPUT, which is then loaded by mapping it, without parsing it.
+    -watch DIR - scan the regular files written to, or moved into, DIR (not
+    its subdirectories) as they land, on THREADS threads, until interrupted.
+    A file is scanned once it has had no events for 100 ms, so a burst of
+    writes scans it once. At most 256 files are queued, the rest wait, and
+    files are dropped if more than 4096 are waiting. Infected files are
+    printed as in -r. SIGUSR1 prints the counters of events, files, stalls
+    and drops, and they are printed again when it stops.
+    -stream SOURCE - scan SOURCE, standard input if it is "-" or else a
+    named pipe or any other file, without the menu, as a stream: it is read
+    as it comes until its end, in 64 KB chunks that overlap by the length of
+    the longest signature minus one, so the memory used is the same however
+    long it is, and a virus crossing two chunks is still found. Viruses are
+    reported at their offset from the start of the stream, as they are
+    found.
+    -passthrough - copy SOURCE to stdout untouched while it is scanned, so
+    virusDetector can sit in the middle of a pipeline. Everything else
+    printed on stdout, the results included unless REPORT is given, goes to
+    stderr instead.
+    -daemon SOCKET - load the signatures once and scan the files the clients
+    of the UNIX socket SOCKET ask for, on THREADS threads, until interrupted.
+    A client sends a line per file, "SCAN PATH" or "FD" with the descriptor
+    of the file attached, and gets a "hit name=NAME size=SIZE offset=OFFSET"
+    line per virus followed by a "verdict=clean|infected|error" line.
+    scanClient is such a client. SIGHUP reloads SIGFILE in the background,
+    the requests made meanwhile are served by the signatures loaded before.
+    As SCAN opens files with the daemon's privileges, only the user running
+    it can connect. At most 256 clients are connected at once, and one that
+    sends nothing for 60 seconds is disconnected.
+    -sigs SIGFILE - the signatures file to use instead of signatures-L.
+    -compile DATABASE - compile the signatures file into a database holding
+    the viruses and their automaton in the native byte order. A database is
+    loaded like any signatures file, by mapping it into memory, so loading
+    doesn't parse or allocate anything per virus.
+    -engine ENGINE - the algorithm every scan runs: automaton (Aho-Corasick),
+    shift (Wu-Manber, which jumps over bytes that can't end a signature),
+    naive (every signature compared at every offset, a reference), or auto,
+    the default, which picks the automaton when a signature is shorter than
+    3 bytes, when there are 49152 signatures or more, or when the prefilter
+    compares the first bytes of the signatures directly (8 distinct first
+    bytes at most), and the shift engine otherwise. All of them find the
+    same viruses. A database is scanned with its automaton unless shift or
+    naive is given.
+    -layout LAYOUT - how the automaton stores its transitions: full, a table
+    of 256 transitions per state (1 KB), or sparse, the children of every
+    state in a bitmap and a failure link followed for other bytes (48 bytes
+    a state). auto, the default, keeps a full table of up to 256 states,
+    a fraction of the L2 cache, as a larger one scans slower than a sparse
+    automaton. A database keeps the layout it was compiled with.
+    -prefilter LEVEL - while no signature is partially matched, offsets that
+    can't start a signature are skipped by comparing many bytes at once with
+    the first bytes of the signatures. LEVEL is off, scalar, sse2 or avx2,
+    the best one the processor supports by default.
+    -stats (or --stats) - count, on every scanning thread, the hits of every
+    signature and the offsets it was checked at, the bytes scanned and the
+    time spent loading, scanning and neutralizing, and print them when the
+    signatures are replaced or the program ends, as key=value lines: a
+    "stats=thread" line per thread, a "stats=total" line with the files
+    scanned per second, and a "stats=signature" line per signature, whose
+    name is last and runs to the end of the line. A signature checked often
+    that never hits only slows the scans down. The daemon doesn't count.
+    -format FORMAT - how the results are written: text, the default, as
+    above, jsonl, an object per line with the path, the event (hit,
+    known_bad or error) and the virus, size, offset (in decimal) and region,
+    sha256 or error, or csv, the same fields as columns under a header line
+    path,event,virus,size,offset,region,detail. Errors other than a file
+    that can't be opened are still printed on stderr.
+    -report REPORT - write the results into REPORT instead of stdout, away
+    from the menu and the counters. The results are buffered and written a
+    file at a time, and as they come while watching.
+    -bench SAMPLE MEGABYTES - scan SAMPLE repeated up to MEGABYTES with every
+    prefilter level, with every engine and with every layout, and print the
+    throughput of each, the memory of every layout per signature, and the
+    engine and the layout auto picks.
+    -benchscan FILE - load the signatures file and scan FILE as the menu
+    does, and print the time each took and the peak memory used, as
+    key=value lines. 'make bench' runs it on generated signatures and files.
 EXAMPLES
     virusDetector
     virusDetector -FILE infected
+    virusDetector -FILE infected -mmap
+    virusDetector -FILE image.iso -pipeline 8 -chunk 1024
+    virusDetector -FILE /bin/ls -elf
+    virusDetector -FILE infected -engine shift
+    virusDetector -r /home -j 8
+    virusDetector -r /home -stats
+    virusDetector -r /home -format jsonl -report home.jsonl
+    virusDetector -compile signatures.db -sigs signatures-L
+    virusDetector -compile big.db -sigs big-L -layout sparse
+    virusDetector -r /home -sigs signatures.db
+    virusDetector -r /home -cache home.cache
+    virusDetector -r /var/lib/containers -dedup
+    virusDetector -compilehashes bad.hashes -hashes bad.sha256
+    virusDetector -r /home -hashes bad.hashes
+    virusDetector -watch /srv/uploads -watch /tmp -j 4
+    curl -s $URL | virusDetector -stream - -passthrough | tar x
+    virusDetector -daemon /tmp/virusDetector.sock -sigs signatures.db
+    virusDetector -bench infected 256
+    virusDetector -benchscan bench/corpus-64 -sigs bench/sigs-1000-L
 */
 
 #include <stdio.h>
@@ -18,50 +174,79 @@ EXAMPLES
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/types.h> // for off_t
+#include <fcntl.h>     // for open
+#include <unistd.h>    // for pwrite and fsync
+#include "../include/virus.h"
+#include "../include/sigArena.h"
+#include "../include/sigPattern.h"
+#include "../include/ahoCorasick.h"
+#include "../include/hitBuffer.h"
+#include "../include/streamScan.h"
+#include "../include/readPipeline.h"
+#include "../include/mappedFile.h"
+#include "../include/elfScan.h"
+#include "../include/dirScan.h"
+#include "../include/dirWatch.h"
+#include "../include/sigDatabase.h"
+#include "../include/prefilter.h"
+#include "../include/scanBench.h"
+#include "../include/scanCache.h"
+#include "../include/scanDaemon.h"
+#include "../include/hashSet.h"
+#include "../include/scanStats.h"
+#include "../include/reportWriter.h"
 
 /* MACROS */
 
 #define INPUT_MAX 8
-#define BUFFER_MAX 10 << 10
 
 #define DEFAULT_SIGFILE "signatures-L"
+#define RET_OPCODE 0xC3
 
 #define ERR_PRE "!>"
 #define REG_PRE ">>"
 #define MSG_PRE "*>"
 
 #define MISSING_FILE_ERR "missing file name"
+#define MISSING_DIR_ERR "missing directory name"
+#define THREADS_ERR "invalid number of threads"
+#define DEPTH_ERR "invalid pipeline depth"
+#define CHUNK_ERR "invalid chunk size"
+#define POOL_ERR "couldn't start the scanning threads"
+#define NO_SIGNATURES_ERR "no signatures loaded"
+#define INVALID_DB_ERR "invalid signatures database"
+#define COMPILE_ERR "failed writing the signatures database"
+#define PREFILTER_ERR "unsupported prefilter level"
+#define ENGINE_ERR "unknown match engine"
+#define LAYOUT_ERR "unknown automaton layout"
+#define BENCH_ERR "missing or unreadable benchmark sample"
+#define CACHE_ERR "failed writing the scan cache"
+#define DAEMON_ERR "couldn't listen on the socket"
+#define WATCH_ERR "couldn't watch the directories"
+#define WATCH_COUNT_ERR "too many directories to watch"
+#define BLOCKLIST_ERR "missing or invalid hash blocklist"
+#define BLOCKLIST_COMPILE_ERR "failed writing the hash blocklist"
+#define BAD_DIGEST_ERR "not a sha256 digest, skipped"
+#define STREAM_ERR "failed reading or copying the stream"
+#define FORMAT_ERR "unknown report format"
+#define REPORT_ERR "couldn't open the report"
+#define REPORT_WRITE_ERR "failed writing the report"
 #define UNKNOWN_ARG_ERR "unknown argument"
 #define FAILED_OPEN_ERR "couldn't open the file"
 #define SEEK_ERR "seeking failed"
 #define WRITE_ERR "failed overwriting the virus's signature"
 #define NOTHING_TO_SCAN_ERR "no file to scan"
+#define READ_ERR "failed reading the file"
+#define BUILD_ERR "failed building the signatures automaton"
+#define MEMORY_ERR "out of memory"
+#define PATTERN_ERR "skipped an invalid signature pattern"
+#define TRUNCATED_ERR "the signatures file ends in the middle of a virus"
 
 #define PRINT_ERROR(MSG) fprintf(stderr, "%s %s\n", ERR_PRE, MSG)
 
 /* STRUCTURES */
 
-typedef struct virus
-{
-    unsigned short SigSize;
-    char virusName[16];
-    unsigned char *sig;
-} virus;
-
-// linked list of viruses
-typedef struct link
-{
-    struct link *nextVirus;
-    virus *vir;
-} link;
-
-// linked list of bytes locations
-typedef struct posLink
-{
-    struct posLink *nextVirus;
-    size_t position;
-} posLink;
-
 // function descriptor
 typedef struct fun_desc
 {
@@ -72,35 +257,89 @@ typedef struct fun_desc
 /* REQUIRED AUXILIARY METHODS */
 
 void SetSigFileName();
-virus *readVirus(FILE *);
+bool readVirus(FILE *, sigArena *);
 void printVirus(virus *);
-void list_print(link *, FILE *);
-link *list_append(link *, virus *);
-void list_free(link *);
+void list_print(sigArena *, FILE *);
+void list_free(sigArena *);
 void quit();
 void detectViruses();
 void fixFile();
-void detect_virus(char *, unsigned int, link *);
-void neutralize_virus(char *, int);
+void detect_virus(char *, unsigned int, sigArena *);
+void neutralize_virus(char *, off_t);
 
 /* ADDITIONAL AUXILIARY METHODS */
 
 void printHexToFile(FILE *, unsigned char *, size_t);
 void openSigFile();
-bool reachedEnd(FILE *);
 void printVirusToFile(FILE *, virus *);
 void loadViruses();
 void printViruses();
 void reset();
-posLink *scanFile(char *, unsigned int, link *, bool);
+size_t scanFile(char *, unsigned int, acAutomaton *, hitBuffer *);
+void printHit(void *, unsigned int, unsigned long long);
+void collectHit(void *, unsigned int, unsigned long long);
+bool scanMapped(bool);
+bool scanSections();
+bool neutralizeAll(int, hitBuffer *);
+bool scanDescriptor(int, hitHandler, void *);
+bool sweepTree();
+bool scanInputStream();
+void printFile(void *, const char *, bool);
+void printDigest(void *, const unsigned char *);
+bool loadBlocklist();
+void printBadLine(void *, const char *, unsigned long);
+void checkBlocklist();
+bool compileBlocklist();
+bool watchTrees();
+void printWatchStatus(void *, const watchSummary *);
+bool compileViruses();
+bool runBenchmark();
+bool runScanBenchmark();
+bool runDaemon();
+sigGeneration *loadGeneration();
+void countScan(unsigned long long, double);
+void printStats();
+bool openReport();
+void closeReport();
 
 /* GLOBALS */
 
 char signaturesFilename[PATH_MAX] = {0};
 char *fileToScan = NULL;
 bool usingBigEndian = false;
+bool usingMmap = false;
+bool elfSections = false;
+int pipelineDepth = 0;
+size_t chunkSize = STREAM_CHUNK;
+char *treeToScan = NULL;
+char *streamToScan = NULL;
+bool passingThrough = false;
+int passthroughFd = -1; // the original stdout, while passing through
+char *watchedDirectories[WATCH_MAX_DIRECTORIES] = {0};
+int watchedCount = 0;
+int threadCount = 0;
+char *cacheFilename = NULL;
+bool rescanning = false;
+bool deduplicating = false;
 FILE *signaturesFile = NULL;
-link *knownVirusesList = NULL;
+sigArena knownViruses = {0};
+acAutomaton *knownVirusesMatcher = NULL;
+sigDatabase *knownVirusesDatabase = NULL;
+hitBuffer scanHits = {0}; // reused by every scan of the menu
+char *databaseToCompile = NULL;
+char *benchSample = NULL;
+unsigned int benchMegabytes = 0;
+char *benchFile = NULL;
+char *daemonSocket = NULL;
+char *blocklistFilename = NULL;
+char *blocklistToCompile = NULL;
+hashSet blocklist = {0};
+bool collectingStats = false;
+unsigned long long statsFiles = 0; // scanned while counting
+double statsWallSeconds = 0;       // spent scanning them
+int reportFormatArgument = REPORT_TEXT;
+char *reportFilename = NULL;
+reportWriter report = {0}; // where every result is written
 
 int main(int argc, char **argv)
 {
@@ -114,7 +353,14 @@ int main(int argc, char **argv)
     int numOfOptions = sizeof(menuItems) / sizeof(menuItems[0]);
     int option = -1, i = 0;
     char input[INPUT_MAX] = {0};
+    char *sigsArgument = DEFAULT_SIGFILE;
     bool errorOccurred = false;
+    const char *levels[] = {"off", "scalar", "sse2", "avx2"};
+    int level;
+    matchEngine engine;
+    acLayout layout;
+
+    prefilterSelect(PREFILTER_BEST);
 
     for (i = 1; i < argc && !errorOccurred; i++)
     {
@@ -130,6 +376,271 @@ int main(int argc, char **argv)
                 errorOccurred = true;
             }
         }
+        else if (!strcmp(argv[i], "-mmap"))
+        {
+            usingMmap = true;
+        }
+        else if (!strcmp(argv[i], "-elf"))
+        {
+            elfSections = true;
+        }
+        else if (!strcmp(argv[i], "-pipeline"))
+        {
+            if (++i >= argc || (pipelineDepth = atoi(argv[i])) < 1 ||
+                pipelineDepth > PIPELINE_MAX_DEPTH)
+            {
+                PRINT_ERROR(DEPTH_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-chunk"))
+        {
+            if (++i >= argc || atoi(argv[i]) < 1 ||
+                atoi(argv[i]) > PIPELINE_MAX_CHUNK >> 10)
+            {
+                PRINT_ERROR(CHUNK_ERR);
+                errorOccurred = true;
+            }
+            else
+            {
+                chunkSize = (size_t)atoi(argv[i]) << 10;
+            }
+        }
+        else if (!strcmp(argv[i], "-r"))
+        {
+            if (++i < argc)
+            {
+                treeToScan = argv[i];
+            }
+            else
+            {
+                PRINT_ERROR(MISSING_DIR_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-stream"))
+        {
+            if (++i < argc)
+            {
+                streamToScan = argv[i];
+            }
+            else
+            {
+                PRINT_ERROR(MISSING_FILE_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-passthrough"))
+        {
+            passingThrough = true;
+        }
+        else if (!strcmp(argv[i], "-watch"))
+        {
+            if (++i >= argc)
+            {
+                PRINT_ERROR(MISSING_DIR_ERR);
+                errorOccurred = true;
+            }
+            else if (watchedCount == WATCH_MAX_DIRECTORIES)
+            {
+                PRINT_ERROR(WATCH_COUNT_ERR);
+                errorOccurred = true;
+            }
+            else
+            {
+                watchedDirectories[watchedCount++] = argv[i];
+            }
+        }
+        else if (!strcmp(argv[i], "-j"))
+        {
+            if (++i >= argc || (threadCount = atoi(argv[i])) < 1)
+            {
+                PRINT_ERROR(THREADS_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-cache"))
+        {
+            if (++i < argc)
+            {
+                cacheFilename = argv[i];
+            }
+            else
+            {
+                PRINT_ERROR(MISSING_FILE_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-rescan"))
+        {
+            rescanning = true;
+        }
+        else if (!strcmp(argv[i], "-dedup"))
+        {
+            deduplicating = true;
+        }
+        else if (!strcmp(argv[i], "-daemon"))
+        {
+            if (++i < argc)
+            {
+                daemonSocket = argv[i];
+            }
+            else
+            {
+                PRINT_ERROR(MISSING_FILE_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-hashes"))
+        {
+            if (++i < argc)
+            {
+                blocklistFilename = argv[i];
+            }
+            else
+            {
+                PRINT_ERROR(MISSING_FILE_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-compilehashes"))
+        {
+            if (++i < argc)
+            {
+                blocklistToCompile = argv[i];
+            }
+            else
+            {
+                PRINT_ERROR(MISSING_FILE_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-compile"))
+        {
+            if (++i < argc)
+            {
+                databaseToCompile = argv[i];
+            }
+            else
+            {
+                PRINT_ERROR(MISSING_FILE_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-prefilter"))
+        {
+            for (level = PREFILTER_OFF; i + 1 < argc && level < PREFILTER_BEST;
+                 level++)
+            {
+                if (!strcmp(argv[i + 1], levels[level]))
+                {
+                    break;
+                }
+            }
+
+            if (++i >= argc || level == PREFILTER_BEST ||
+                !prefilterSelect(level))
+            {
+                PRINT_ERROR(PREFILTER_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-engine"))
+        {
+            for (engine = ENGINE_AUTOMATON;
+                 i + 1 < argc && engine <= ENGINE_AUTO; engine++)
+            {
+                if (!strcmp(argv[i + 1], engineName(engine)))
+                {
+                    break;
+                }
+            }
+
+            if (++i >= argc || !engineSelect(engine))
+            {
+                PRINT_ERROR(ENGINE_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-layout"))
+        {
+            for (layout = AC_LAYOUT_FULL;
+                 i + 1 < argc && layout <= AC_LAYOUT_AUTO; layout++)
+            {
+                if (!strcmp(argv[i + 1], acLayoutName(layout)))
+                {
+                    break;
+                }
+            }
+
+            if (++i >= argc || !acLayoutSelect(layout))
+            {
+                PRINT_ERROR(LAYOUT_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-bench"))
+        {
+            if (i + 2 < argc && (benchMegabytes = atoi(argv[i + 2])) > 0)
+            {
+                benchSample = argv[i + 1];
+                i += 2;
+            }
+            else
+            {
+                PRINT_ERROR(BENCH_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-benchscan"))
+        {
+            if (++i < argc)
+            {
+                benchFile = argv[i];
+            }
+            else
+            {
+                PRINT_ERROR(MISSING_FILE_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-stats") || !strcmp(argv[i], "--stats"))
+        {
+            collectingStats = true;
+        }
+        else if (!strcmp(argv[i], "-format"))
+        {
+            if (++i >= argc ||
+                (reportFormatArgument = reportFormatFind(argv[i])) == -1)
+            {
+                PRINT_ERROR(FORMAT_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-report"))
+        {
+            if (++i < argc)
+            {
+                reportFilename = argv[i];
+            }
+            else
+            {
+                PRINT_ERROR(MISSING_FILE_ERR);
+                errorOccurred = true;
+            }
+        }
+        else if (!strcmp(argv[i], "-sigs"))
+        {
+            if (++i < argc)
+            {
+                sigsArgument = argv[i];
+            }
+            else
+            {
+                PRINT_ERROR(MISSING_FILE_ERR);
+                errorOccurred = true;
+            }
+        }
         else
         {
             PRINT_ERROR(UNKNOWN_ARG_ERR);
@@ -137,7 +648,54 @@ int main(int argc, char **argv)
         }
     }
 
-    strcpy(signaturesFilename, DEFAULT_SIGFILE);
+    strncpy(signaturesFilename, sigsArgument, PATH_MAX - 1);
+
+    // only the stream goes to the original stdout, everything printed goes
+    // to stderr
+    if (!errorOccurred && streamToScan && passingThrough)
+    {
+        fflush(stdout);
+
+        if ((passthroughFd = dup(STDOUT_FILENO)) == -1 ||
+            dup2(STDERR_FILENO, STDOUT_FILENO) == -1)
+        {
+            PRINT_ERROR(STREAM_ERR);
+            errorOccurred = true;
+        }
+    }
+
+    if (!errorOccurred)
+    {
+        errorOccurred = !openReport();
+    }
+
+    // the blocklist is loaded once, it doesn't change with the signatures
+    if (!errorOccurred && (blocklistFilename || blocklistToCompile))
+    {
+        errorOccurred = !loadBlocklist();
+    }
+
+    // compiling, benchmarking, serving, watching and scanning a directory
+    // or a stream skip the menu
+    if (!errorOccurred && (blocklistToCompile || databaseToCompile ||
+                           benchSample || benchFile || daemonSocket ||
+                           watchedCount || treeToScan || streamToScan))
+    {
+        errorOccurred = blocklistToCompile  ? !compileBlocklist()
+                        : databaseToCompile ? !compileViruses()
+                        : benchSample     ? !runBenchmark()
+                        : benchFile       ? !runScanBenchmark()
+                        : daemonSocket    ? !runDaemon()
+                        : watchedCount    ? !watchTrees()
+                        : streamToScan    ? !scanInputStream()
+                                          : !sweepTree();
+        printStats();
+        closeReport();
+        reset();
+        hashSetFree(&blocklist);
+
+        return errorOccurred;
+    }
 
     // no signature file name means the user wants to quit
     while (!errorOccurred && strcmp(signaturesFilename, ""))
@@ -196,35 +754,76 @@ void SetSigFileName()
 }
 
 /**
- * @brief this function reads the next virus from a file.
+ * @brief this function reads the next virus from a file into an arena.
+ * a pattern is compiled, and skipped if it is invalid. a virus cut short by
+ * the end of the file is reported and not appended.
  *
  * @param file a file to read/scan.
+ * @param arena the arena to append the virus to.
  *
  * @pre current position in file is a beginning of a virus.
- * @return virus* the next virus in the file.
+ * @return true if a virus was read, false at the end of the file.
  */
-virus *readVirus(FILE *file)
+bool readVirus(FILE *file, sigArena *arena)
 {
-    virus *newVirus = (virus *)calloc(1, sizeof(virus));
+    virus header;
+    virus *newVirus;
+    char text[SIG_LENGTH];
+    unsigned char compiled[PATTERN_MAX_SIZE];
+    size_t size;
 
     // get the size of the signature and the virus name, together
 
-    fread(newVirus, sizeof(unsigned char), 2 + 16, file);
+    if ((size = fread(&header, sizeof(unsigned char), sizeof(virus), file)) !=
+        sizeof(virus))
+    {
+        if (size)
+        {
+            PRINT_ERROR(TRUNCATED_ERR);
+        }
+
+        return false;
+    }
 
     // swap the bytes
     if (usingBigEndian)
     {
-        newVirus->SigSize = (newVirus->SigSize << 8) | (newVirus->SigSize >> 8);
+        header.SigSize = (header.SigSize << 8) | (header.SigSize >> 8);
+    }
+
+    // a plain signature is read whole before it is appended, like a pattern
+    size = header.SigSize & SIG_LENGTH;
+
+    if (fread(text, sizeof(char), size, file) != size)
+    {
+        PRINT_ERROR(TRUNCATED_ERR);
+        return false;
     }
 
-    // get the name and the signature of the virus
+    if (header.SigSize & SIG_PATTERN)
+    {
+        if (!(size = patternCompile(text, size, compiled)))
+        {
+            PRINT_ERROR(PATTERN_ERR);
+            return true;
+        }
+
+        header.SigSize = SIG_PATTERN | size;
+    }
+
+    // the record goes right after the previous one
 
-    newVirus->sig = (unsigned char *)calloc(newVirus->SigSize,
-                                            sizeof(unsigned char));
+    if (!(newVirus = arenaAppend(arena, header.SigSize)))
+    {
+        return false;
+    }
 
-    fread(newVirus->sig, sizeof(unsigned char), newVirus->SigSize, file);
+    memcpy(newVirus->virusName, header.virusName, sizeof(header.virusName));
+    memcpy(newVirus->sig, header.SigSize & SIG_PATTERN ? compiled
+                                                       : (unsigned char *)text,
+           header.SigSize & SIG_LENGTH);
 
-    return newVirus;
+    return true;
 }
 
 /**
@@ -238,60 +837,30 @@ void printVirus(virus *virus)
 }
 
 /**
- * @brief print the data of every link in list to the given stream.
- * Each item followed by a newline character.
+ * @brief print the data of every virus in the arena to the given stream,
+ * in list order. Each item followed by a newline character.
  *
- * @param virus_list a linked list of viruses.
+ * @param virus_list an arena of viruses.
  * @param stream an output stream.
  * @pre stream is open.
  */
-void list_print(link *virus_list, FILE *stream)
+void list_print(sigArena *virus_list, FILE *stream)
 {
-    while (virus_list)
+    for (unsigned int i = 0; i < virus_list->count; i++)
     {
-        printVirusToFile(stream, virus_list->vir);
+        printVirusToFile(stream, arenaVirus(virus_list, i));
         fputc('\n', stream);
-
-        virus_list = virus_list->nextVirus;
     }
 }
 
 /**
- * @brief add a new link with the given data at the beginning of the list.
- *
- * @param virus_list a list of viruses.
- * @param data a virus to append.
- * @return link* a pointer to the list (i.e., the first link in the list).
- */
-link *list_append(link *virus_list, virus *data)
-{
-    link *newLink = (link *)calloc(1, sizeof(link));
-
-    newLink->nextVirus = virus_list;
-    newLink->vir = data;
-
-    return newLink;
-}
-
-/**
- * @brief free the memory allocated by the list.
+ * @brief free the memory allocated by the arena, all at once.
  *
  * @param virus_list
  */
-void list_free(link *virus_list)
+void list_free(sigArena *virus_list)
 {
-    link *curr = virus_list, *next = NULL;
-
-    while (curr)
-    {
-        next = curr->nextVirus;
-
-        free(curr->vir->sig);
-        free(curr->vir);
-        free(curr);
-
-        curr = next;
-    }
+    arenaFree(virus_list);
 }
 
 /**
@@ -299,10 +868,9 @@ void list_free(link *virus_list)
  */
 void fixFile()
 {
-    FILE *file = NULL;
-    char buffer[BUFFER_MAX] = {0};
-    size_t bytesRead;
-    posLink *infections = NULL, *next;
+    scanStats *stats;
+    double start = statsClock(), fixing;
+    int fd;
 
     if (!fileToScan)
     {
@@ -310,25 +878,46 @@ void fixFile()
         return;
     }
 
-    if ((file = fopen(fileToScan, "r")) == NULL)
+    if (!knownVirusesMatcher)
+    {
+        return;
+    }
+
+    // a file that can't be mapped is read instead
+    if (usingMmap && scanMapped(true))
+    {
+        countScan(1, start);
+        return;
+    }
+
+    // the same descriptor scans the file and neutralizes every virus in it
+    if ((fd = open(fileToScan, O_RDWR)) == -1)
     {
         PRINT_ERROR(FAILED_OPEN_ERR);
         return;
     }
 
-    bytesRead = fread(buffer, sizeof(char), BUFFER_MAX, file);
-    fclose(file);
+    hitClear(&scanHits);
+
+    if (!scanDescriptor(fd, collectHit, &scanHits))
+    {
+        PRINT_ERROR(READ_ERR);
+    }
 
-    infections = scanFile(buffer, bytesRead, knownVirusesList, false);
+    fixing = statsClock();
 
-    while (infections)
+    if (!neutralizeAll(fd, &scanHits))
     {
-        neutralize_virus(fileToScan, infections->position);
+        PRINT_ERROR(WRITE_ERR);
+    }
 
-        next = infections->nextVirus;
-        free(infections);
-        infections = next;
+    if ((stats = statsThread()))
+    {
+        stats->neutralizeSeconds += statsClock() - fixing;
     }
+
+    close(fd);
+    countScan(1, start);
 }
 
 /**
@@ -337,8 +926,7 @@ void fixFile()
 void detectViruses()
 {
     FILE *file = NULL;
-    char buffer[BUFFER_MAX] = {0};
-    size_t bytesRead;
+    double start = statsClock();
 
     if (!fileToScan)
     {
@@ -346,17 +934,41 @@ void detectViruses()
         return;
     }
 
-    if ((file = fopen(fileToScan, "r")) == NULL)
+    if (!knownVirusesMatcher)
     {
+        return;
+    }
+
+    reportFile(&report, fileToScan, NULL);
+
+    if (blocklistFilename)
+    {
+        checkBlocklist();
+    }
+
+    if ((elfSections && scanSections()) || (usingMmap && scanMapped(false)))
+    {
+        reportFlush(&report);
+        countScan(1, start);
+        return;
+    }
+
+    if ((file = fopen(fileToScan, "r")) == NULL)
+    {
+        reportFlush(&report);
         PRINT_ERROR(FAILED_OPEN_ERR);
         return;
     }
 
-    bytesRead = fread(buffer, sizeof(char), BUFFER_MAX, file);
-    fclose(file);
+    // the whole file is scanned, one chunk at a time
+    if (!scanDescriptor(fileno(file), printHit, knownVirusesMatcher))
+    {
+        PRINT_ERROR(READ_ERR);
+    }
 
-    // assuming bytesRead <= BUFFER_MAX
-    detect_virus(buffer, bytesRead, knownVirusesList);
+    fclose(file);
+    reportFlush(&report);
+    countScan(1, start);
 }
 
 /**
@@ -368,18 +980,39 @@ void detectViruses()
  * @param buffer content of a file.
  * @param size the minimum between the size of the buffer and the size of the
  * suspected file in bytes
- * @param virus_list list of known viruses' signatures.
+ * @param virus_list a sealed arena of known viruses' signatures.
  */
-void detect_virus(char *buffer, unsigned int size, link *virus_list)
+void detect_virus(char *buffer, unsigned int size, sigArena *virus_list)
 {
-    posLink *infections = scanFile(buffer, size, virus_list, true);
-    posLink *next;
+    acAutomaton *matcher = knownVirusesMatcher;
+    scanStats *stats = NULL;
+    size_t count, i;
+
+    // viruses other than the loaded ones need an automaton of their own
+    if (virus_list != &knownViruses)
+    {
+        matcher = acBuild(virus_list);
+    }
+
+    count = scanFile(buffer, size, matcher, &scanHits);
+
+    // the counters are of the loaded viruses only
+    if (matcher == knownVirusesMatcher)
+    {
+        stats = statsThread();
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        statsHit(stats, scanHits.hits[i].virusIndex);
+        printHit(matcher, scanHits.hits[i].virusIndex, scanHits.hits[i].offset);
+    }
 
-    while (infections)
+    reportFlush(&report);
+
+    if (matcher != knownVirusesMatcher)
     {
-        next = infections->nextVirus;
-        free(infections);
-        infections = next;
+        acFree(matcher);
     }
 }
 
@@ -389,26 +1022,23 @@ void detect_virus(char *buffer, unsigned int size, link *virus_list)
  * @param fileName the infected file's name.
  * @param signatureOffset the first byte of the virus' signature in the file.
  */
-void neutralize_virus(char *fileName, int signatureOffset)
+void neutralize_virus(char *fileName, off_t signatureOffset)
 {
     FILE *infected = fopen(fileName, "r+");
-    const char RET[] = {(char)0xC3};
+    const char RET[] = {(char)RET_OPCODE};
 
     if (infected)
     {
-        if (fseek(infected, signatureOffset, SEEK_SET) == -1)
+        if (fseeko(infected, signatureOffset, SEEK_SET) == -1)
         {
             PRINT_ERROR(SEEK_ERR);
         }
-        else
+        else if (fwrite(RET, 1, 1, infected) != 1)
         {
-            if (fwrite(RET, 1, 1, infected) != 1)
-            {
-                PRINT_ERROR(WRITE_ERR);
-            }
-
-            fclose(infected);
+            PRINT_ERROR(WRITE_ERR);
         }
+
+        fclose(infected);
     }
     else
     {
@@ -416,6 +1046,31 @@ void neutralize_virus(char *fileName, int signatureOffset)
     }
 }
 
+/**
+ * @brief deactivate every virus found in a file, through a single
+ * descriptor, and flush the file to the disk once.
+ *
+ * @param fd a descriptor of the infected file, open for writing.
+ * @param infections the viruses found in the file.
+ * @return true if every virus was neutralized and the file was flushed.
+ */
+bool neutralizeAll(int fd, hitBuffer *infections)
+{
+    const unsigned char RET[] = {RET_OPCODE};
+    bool ok = true;
+    size_t i;
+
+    for (i = 0; i < infections->count; i++)
+    {
+        if (pwrite(fd, RET, 1, infections->hits[i].offset) != 1)
+        {
+            ok = false;
+        }
+    }
+
+    return fsync(fd) == 0 && ok;
+}
+
 /**
  * @brief prints memory in hexadecimal format.
  *
@@ -427,10 +1082,14 @@ void neutralize_virus(char *fileName, int signatureOffset)
  */
 void printHexToFile(FILE *file, unsigned char *buffer, size_t length)
 {
-    for (size_t i = 0; i < length; i++)
+    char line[3 * 256];
+    size_t part;
+
+    // three characters a byte, a few hundred bytes per write
+    for (size_t i = 0; i < length; i += part)
     {
-        // 02 for a two-digit representation, hh is for a char
-        fprintf(file, "%02hhx ", buffer[i]);
+        part = length - i < 256 ? length - i : 256;
+        fwrite(line, 1, reportHex(line, buffer + i, part, true), file);
     }
 }
 
@@ -444,6 +1103,8 @@ void openSigFile()
     signaturesFile = fopen(signaturesFilename, "r");
     char magicNumber[4] = {0};
 
+    usingBigEndian = false;
+
     if (signaturesFile)
     {
         fread(magicNumber, sizeof(char), 4, signaturesFile);
@@ -453,6 +1114,19 @@ void openSigFile()
         {
             usingBigEndian = true;
         }
+        else if (strncmp(magicNumber, DB_MAGIC, 4) == 0)
+        {
+            // a compiled database is mapped rather than read
+
+            fclose(signaturesFile);
+
+            signaturesFile = NULL;
+
+            if (!(knownVirusesDatabase = dbOpen(signaturesFilename)))
+            {
+                PRINT_ERROR(INVALID_DB_ERR);
+            }
+        }
         else if (strncmp(magicNumber, "VIRL", 4))
         {
             // the number is not VIRL nor VIRB (then strncmp would have
@@ -469,29 +1143,6 @@ void openSigFile()
     }
 }
 
-/**
- * @brief checks if the entire file was read.
- *
- * @param file a file to check.
- *
- * @pre file is an open file.
- * @return true if we read the entire file.
- * @return false if we did not read the entire file.
- */
-bool reachedEnd(FILE *file)
-{
-    // read one byte, then check EOF
-    if (fgetc(file) == EOF)
-    {
-        return true;
-    }
-
-    // "undo"
-    fseek(file, -1, SEEK_CUR);
-
-    return false;
-}
-
 /**
  * @brief prints the virus data to a file.
  *
@@ -503,9 +1154,17 @@ bool reachedEnd(FILE *file)
 void printVirusToFile(FILE *file, virus *virus)
 {
     fprintf(file, "# name:         %s\n", virus->virusName);
-    fprintf(file, "# sig_size:     %d\n", virus->SigSize);
+    fprintf(file, "# sig_size:     %d\n", virusLength(virus));
     fprintf(file, "# signature:    ");
-    printHexToFile(file, virus->sig, virus->SigSize);
+
+    if (virus->SigSize & SIG_PATTERN)
+    {
+        patternPrint(file, virusPattern(virus));
+    }
+    else
+    {
+        printHexToFile(file, virus->sig, virus->SigSize);
+    }
 }
 
 /**
@@ -513,18 +1172,46 @@ void printVirusToFile(FILE *file, virus *virus)
  */
 void loadViruses()
 {
+    scanStats *stats;
+    double start;
+
+    // the counters of the signatures loaded before are printed first
+    printStats();
+    start = statsClock();
     openSigFile();
 
-    if (signaturesFile)
+    if (knownVirusesDatabase)
+    {
+        // the database's arena is mapped, releasing it is a no-op
+        knownViruses = knownVirusesDatabase->arena;
+        knownVirusesMatcher = &knownVirusesDatabase->automaton;
+    }
+    else if (signaturesFile)
     {
         fseek(signaturesFile, 4, SEEK_SET);
 
-        knownVirusesList = NULL;
+        while (readVirus(signaturesFile, &knownViruses))
+        {
+        }
+
+        if (!arenaSeal(&knownViruses) ||
+            (knownViruses.count &&
+             !(knownVirusesMatcher = acBuild(&knownViruses))))
+        {
+            PRINT_ERROR(BUILD_ERR);
+        }
+    }
 
-        while (!reachedEnd(signaturesFile))
+    // the daemon's signatures are replaced while it scans
+    if (collectingStats && !daemonSocket && knownVirusesMatcher)
+    {
+        statsReset(knownViruses.count);
+        statsFiles = 0;
+        statsWallSeconds = 0;
+
+        if ((stats = statsThread()))
         {
-            knownVirusesList = list_append(knownVirusesList,
-                                           readVirus(signaturesFile));
+            stats->loadSeconds = statsClock() - start;
         }
     }
 }
@@ -534,13 +1221,13 @@ void loadViruses()
  */
 void printViruses()
 {
-    if (!knownVirusesList)
+    if (!knownViruses.count)
     {
         printf("%s no viruses to show\n", MSG_PRE);
     }
     else
     {
-        list_print(knownVirusesList, stdout);
+        list_print(&knownViruses, stdout);
     }
 }
 
@@ -557,9 +1244,21 @@ void reset()
         signaturesFile = NULL;
     }
 
-    list_free(knownVirusesList);
+    if (knownVirusesDatabase)
+    {
+        dbClose(knownVirusesDatabase);
+    }
+    else
+    {
+        acFree(knownVirusesMatcher);
+    }
+
+    list_free(&knownViruses);
 
-    knownVirusesList = NULL;
+    knownVirusesDatabase = NULL;
+    knownVirusesMatcher = NULL;
+
+    hitFree(&scanHits);
 }
 
 /**
@@ -567,9 +1266,12 @@ void reset()
  */
 void quit()
 {
+    printStats();
+    closeReport();
     reset();
 
     memset(signaturesFilename, 0, PATH_MAX);
+    hashSetFree(&blocklist);
 
     printf("%s bye!\n", REG_PRE);
 }
@@ -579,44 +1281,773 @@ void quit()
  *
  * @param buffer a buffer to scan.
  * @param size the size of the buffer.
- * @param virus_list viruses to look for.
- * @param print should the method inform the use about each virus it finds?
- * @return posLink* a list of position of viruses in the buffer.
+ * @param matcher an automaton of the viruses to look for.
+ * @param hits receives the viruses found, sorted by offset.
+ * @return size_t the number of viruses found.
  */
-posLink *scanFile(char *buffer, unsigned int size, link *virus_list, bool print)
+size_t scanFile(char *buffer, unsigned int size, acAutomaton *matcher,
+                hitBuffer *hits)
 {
-    size_t i;
-    link *current;
-    posLink *head = NULL, *tmp = NULL;
+    hitClear(hits);
 
-    if (!virus_list)
+    if (!matcher)
     {
-        return head;
+        return 0;
     }
 
-    for (i = 0; i < size; i++)
+    return acScan(matcher, (unsigned char *)buffer, size, hits);
+}
+
+/**
+ * @brief inform the user about a virus found in the scanned file.
+ *
+ * @param context the automaton the virus belongs to.
+ * @param virusIndex the virus found.
+ * @param offset the first byte of the virus' signature in the file.
+ */
+void printHit(void *context, unsigned int virusIndex, unsigned long long offset)
+{
+    virus *vir = acVirus((acAutomaton *)context, virusIndex);
+
+    reportHit(&report, vir->virusName, virusLength(vir), offset, NULL);
+}
+
+/**
+ * @brief add a virus found in the scanned file to a hit buffer.
+ *
+ * @param context a hit buffer.
+ * @param virusIndex the virus found.
+ * @param offset the first byte of the virus' signature in the file.
+ */
+void collectHit(void *context, unsigned int virusIndex,
+                unsigned long long offset)
+{
+    if (!hitAppend((hitBuffer *)context, virusIndex, offset))
     {
-        current = virus_list;
+        PRINT_ERROR(MEMORY_ERR);
+    }
+}
+
+/**
+ * @brief scan a file one chunk at a time, reading it on a thread of its
+ * own if -pipeline was given.
+ *
+ * @param fd a descriptor of the file.
+ * @param onHit called for every virus found.
+ * @param context passed to onHit.
+ * @return true if the whole file was read.
+ */
+bool scanDescriptor(int fd, hitHandler onHit, void *context)
+{
+    pipelineStats stats;
+    bool ok;
+
+    if (pipelineDepth == 0)
+    {
+        return streamScanFd(fd, knownVirusesMatcher, onHit, context);
+    }
+
+    ok = pipelineScanFd(fd, knownVirusesMatcher, pipelineDepth, chunkSize,
+                        onHit, context, &stats);
+
+    reportFlush(&report);
+    printf("%s read %llu chunks and skipped %llu bytes of holes: the reader "
+           "waited %.6fs (%llu times), the scanner waited %.6fs (%llu times)\n",
+           MSG_PRE, stats.chunks, stats.holeBytes, stats.readerSeconds,
+           stats.readerStalls, stats.scannerSeconds, stats.scannerStalls);
 
-        while (current)
+    return ok;
+}
+
+/**
+ * @brief scan the scanned file through a memory mapping, and either print the
+ * viruses found or neutralize them directly in the mapping.
+ *
+ * @param fix should the viruses be neutralized rather than printed?
+ * @return true if the file was mapped, false if it should be read instead.
+ */
+bool scanMapped(bool fix)
+{
+    scanStats *stats = statsThread();
+    mappedFile file;
+    scanHit *hits;
+    size_t count, i;
+    double fixing;
+
+    if (!mapFile(&file, fileToScan, fix))
+    {
+        return false;
+    }
+
+    hitClear(&scanHits);
+    count = acScan(knownVirusesMatcher, file.data, file.size, &scanHits);
+    hits = scanHits.hits;
+    fixing = statsClock();
+
+    // every hit is found before the first byte is overwritten
+    for (i = 0; i < count; i++)
+    {
+        statsHit(stats, hits[i].virusIndex);
+
+        if (fix)
         {
-            if (!memcmp(buffer + i, current->vir->sig, current->vir->SigSize))
-            {
-                if (print)
-                {
-                    printf("# %s (%d) @ 0x%04x\n",
-                           current->vir->virusName, current->vir->SigSize, i);
-                }
+            file.data[hits[i].offset] = RET_OPCODE;
+        }
+        else
+        {
+            printHit(knownVirusesMatcher, hits[i].virusIndex, hits[i].offset);
+        }
+    }
 
-                tmp = (posLink *)calloc(1, sizeof(posLink));
-                tmp->position = i;
-                tmp->nextVirus = head;
-                head = tmp;
-            }
+    if (fix && !syncFile(&file))
+    {
+        PRINT_ERROR(WRITE_ERR);
+    }
+
+    if (fix && stats)
+    {
+        stats->neutralizeSeconds += statsClock() - fixing;
+    }
+
+    unmapFile(&file);
+
+    return true;
+}
 
-            current = current->nextVirus;
+/**
+ * @brief scan only the code of the scanned file if it is an ELF file, and
+ * print the viruses found by section and offset in the section.
+ *
+ * @return true if the file was an ELF file, false if it should be scanned
+ * whole instead.
+ */
+bool scanSections()
+{
+    scanStats *stats = statsThread();
+    mappedFile file;
+    elfRegion *regions;
+    virus *vir;
+    scanHit *hits;
+    unsigned long long scanned = 0;
+    size_t count, j;
+    int regionCount, i;
+
+    if (!mapFile(&file, fileToScan, false))
+    {
+        return false;
+    }
+
+    if ((regionCount = elfRegions(file.data, file.size, &regions)) == -1)
+    {
+        unmapFile(&file);
+        return false;
+    }
+
+    for (i = 0; i < regionCount; i++)
+    {
+        hitClear(&scanHits);
+        count = acScan(knownVirusesMatcher, file.data + regions[i].offset,
+                       regions[i].size, &scanHits);
+        hits = scanHits.hits;
+        scanned += regions[i].size;
+
+        for (j = 0; j < count; j++)
+        {
+            vir = acVirus(knownVirusesMatcher, hits[j].virusIndex);
+            statsHit(stats, hits[j].virusIndex);
+            reportHit(&report, vir->virusName, virusLength(vir),
+                      hits[j].offset, regions[i].name);
         }
     }
 
-    return head;
+    reportFlush(&report);
+
+    printf("%s scanned %llu of %llu bytes in %d executable regions\n", MSG_PRE,
+           scanned, (unsigned long long)file.size, regionCount);
+
+    free(regions);
+    unmapFile(&file);
+
+    return true;
+}
+
+/**
+ * @brief scan every file in the directory tree given with -r using the
+ * signatures file, and print the results of every infected file.
+ *
+ * @return true if the tree was scanned.
+ */
+bool sweepTree()
+{
+    treeSummary summary;
+    scanCache cache;
+    bool scanned;
+    double start;
+
+    loadViruses();
+
+    if (!knownVirusesMatcher)
+    {
+        PRINT_ERROR(NO_SIGNATURES_ERR);
+        return false;
+    }
+
+    // the verdicts are only valid for the signatures and the blocklist they
+    // were found with
+    if (cacheFilename &&
+        !cacheOpen(&cache, cacheFilename,
+                   arenaDigest(&knownViruses) ^
+                       (blocklistFilename ? hashSetDigest(&blocklist) : 0),
+                   rescanning))
+    {
+        PRINT_ERROR(CACHE_ERR);
+        return false;
+    }
+
+    // every infected file is named before its viruses
+    report.namingFiles = true;
+    start = statsClock();
+    scanned = scanTree(treeToScan, knownVirusesMatcher,
+                       threadCount > 0 ? threadCount : defaultThreadCount(),
+                       cacheFilename ? &cache : NULL, deduplicating,
+                       blocklistFilename ? &blocklist : NULL, printFile,
+                       printHit, printDigest, knownVirusesMatcher, &summary);
+    countScan(summary.files, start);
+    reportFlush(&report);
+
+    if (cacheFilename)
+    {
+        if (scanned && !cacheSave(&cache))
+        {
+            PRINT_ERROR(CACHE_ERR);
+        }
+
+        cacheClose(&cache);
+    }
+
+    if (!scanned)
+    {
+        PRINT_ERROR(POOL_ERR);
+        return false;
+    }
+
+    printf("%s scanned %llu files: %llu infected, %llu failed\n", MSG_PRE,
+           summary.files, summary.infected, summary.failed);
+
+    if (cacheFilename)
+    {
+        printf("%s %llu unchanged files skipped\n", MSG_PRE, summary.unchanged);
+    }
+
+    if (deduplicating)
+    {
+        printf("%s %llu hard links and %llu copies of %llu hashed files "
+               "reused a verdict\n",
+               MSG_PRE, summary.sameInode, summary.sameContent, summary.hashed);
+    }
+
+    if (blocklistFilename)
+    {
+        printf("%s %llu files on the hash blocklist\n", MSG_PRE,
+               summary.knownBad);
+    }
+
+    return true;
+}
+
+/**
+ * @brief scan the stream given with -stream until its end, and copy it to
+ * the original stdout with -passthrough.
+ *
+ * @return true if the whole stream was read, and copied.
+ */
+bool scanInputStream()
+{
+    bool standardInput = !strcmp(streamToScan, "-");
+    int fd = STDIN_FILENO;
+    double start;
+    bool ok;
+
+    loadViruses();
+
+    if (!knownVirusesMatcher)
+    {
+        PRINT_ERROR(NO_SIGNATURES_ERR);
+        return false;
+    }
+
+    if (!standardInput && (fd = open(streamToScan, O_RDONLY)) == -1)
+    {
+        PRINT_ERROR(FAILED_OPEN_ERR);
+        return false;
+    }
+
+    // a stream may not end, its viruses are reported as they are found
+    report.eager = true;
+    reportFile(&report, streamToScan, NULL);
+    start = statsClock();
+
+    ok = streamScanPipe(fd, passingThrough ? passthroughFd : -1,
+                        knownVirusesMatcher, printHit, knownVirusesMatcher);
+
+    countScan(1, start);
+    reportFlush(&report);
+
+    if (!standardInput)
+    {
+        close(fd);
+    }
+
+    if (!ok)
+    {
+        PRINT_ERROR(STREAM_ERR);
+    }
+
+    return ok;
+}
+
+/**
+ * @brief scan the files landing in the directories given with -watch until
+ * interrupted.
+ *
+ * @return true if the directories were watched.
+ */
+bool watchTrees()
+{
+    watchSummary summary;
+    double start;
+
+    loadViruses();
+
+    if (!knownVirusesMatcher)
+    {
+        PRINT_ERROR(NO_SIGNATURES_ERR);
+        return false;
+    }
+
+    // the files are reported as they are scanned, not when the watch ends
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    report.namingFiles = true;
+    report.eager = true;
+    printf("%s watching %d directories\n", MSG_PRE, watchedCount);
+
+    start = statsClock();
+
+    if (!watchDirectories(watchedDirectories, watchedCount,
+                          knownVirusesMatcher,
+                          threadCount > 0 ? threadCount : defaultThreadCount(),
+                          printFile, printHit, printWatchStatus,
+                          knownVirusesMatcher, &summary))
+    {
+        PRINT_ERROR(WATCH_ERR);
+        return false;
+    }
+
+    printWatchStatus(NULL, &summary);
+    countScan(summary.files, start);
+
+    return true;
+}
+
+/**
+ * @brief print the counters of a watch.
+ *
+ * @param context unused.
+ * @param summary the counters.
+ */
+void printWatchStatus(void *context, const watchSummary *summary)
+{
+    printf("%s %llu events (%llu merged): scanned %llu files, %llu infected, "
+           "%llu failed, %llu vanished\n",
+           MSG_PRE, summary->events, summary->merged, summary->files,
+           summary->infected, summary->failed, summary->vanished);
+    printf("%s queue peak %u of %d: %llu files stalled, %llu dropped, "
+           "%llu event overflows\n",
+           MSG_PRE, summary->queuePeak, WATCH_QUEUE_MAX, summary->stalled,
+           summary->dropped, summary->overflows);
+}
+
+/**
+ * @brief inform the user about an infected file, or a file that couldn't
+ * be scanned.
+ *
+ * @param context unused.
+ * @param path the file's path.
+ * @param failed was the file impossible to scan?
+ */
+void printFile(void *context, const char *path, bool failed)
+{
+    reportFile(&report, path, failed ? FAILED_OPEN_ERR : NULL);
+}
+
+/**
+ * @brief inform the user that a file is on the hash blocklist.
+ *
+ * @param context unused.
+ * @param digest the file's SHA-256.
+ */
+void printDigest(void *context, const unsigned char *digest)
+{
+    reportDigest(&report, digest);
+}
+
+/**
+ * @brief load the hash blocklist given with -hashes.
+ *
+ * @return true if it was loaded.
+ */
+bool loadBlocklist()
+{
+    if (!blocklistFilename ||
+        !hashSetLoad(&blocklist, blocklistFilename, printBadLine, NULL))
+    {
+        PRINT_ERROR(BLOCKLIST_ERR);
+        return false;
+    }
+
+    printf("%s loaded %zu digests from %s (%.1f bytes each)\n", MSG_PRE,
+           blocklist.count, blocklistFilename,
+           blocklist.count ? (double)hashSetMemory(&blocklist) /
+                                 blocklist.count
+                           : 0.0);
+
+    if (blocklist.skipped)
+    {
+        printf("%s skipped %zu lines of %s that weren't digests\n", MSG_PRE,
+               blocklist.skipped, blocklistFilename);
+    }
+
+    return true;
+}
+
+/**
+ * @brief inform the user about a line of the blocklist that was skipped.
+ *
+ * @param context unused.
+ * @param path the blocklist.
+ * @param line the line, numbered from 1.
+ */
+void printBadLine(void *context, const char *path, unsigned long line)
+{
+    fprintf(stderr, "%s %s:%lu: %s\n", ERR_PRE, path, line, BAD_DIGEST_ERR);
+}
+
+/**
+ * @brief look up the SHA-256 of the scanned file on the hash blocklist.
+ */
+void checkBlocklist()
+{
+    unsigned char digest[SHA256_SIZE];
+    int fd;
+
+    if ((fd = open(fileToScan, O_RDONLY)) == -1)
+    {
+        PRINT_ERROR(FAILED_OPEN_ERR);
+        return;
+    }
+
+    if (!sha256File(fd, digest))
+    {
+        PRINT_ERROR(READ_ERR);
+    }
+    else if (hashSetContains(&blocklist, digest))
+    {
+        printDigest(NULL, digest);
+    }
+
+    close(fd);
+}
+
+/**
+ * @brief write the hash blocklist into the file given with -compilehashes.
+ *
+ * @return true if it was written.
+ */
+bool compileBlocklist()
+{
+    if (!hashSetCompile(&blocklist, blocklistToCompile))
+    {
+        PRINT_ERROR(BLOCKLIST_COMPILE_ERR);
+        return false;
+    }
+
+    printf("%s compiled %zu digests into %s\n", MSG_PRE, blocklist.count,
+           blocklistToCompile);
+
+    return true;
+}
+
+/**
+ * @brief compile the signatures file into the database given with -compile.
+ *
+ * @return true if the database was written.
+ */
+bool compileViruses()
+{
+    // a database holds the automaton, whatever engine scans with it
+    engineSelect(ENGINE_AUTOMATON);
+    loadViruses();
+
+    if (!knownVirusesMatcher)
+    {
+        PRINT_ERROR(NO_SIGNATURES_ERR);
+        return false;
+    }
+
+    if (!dbCompile(databaseToCompile, knownVirusesMatcher))
+    {
+        PRINT_ERROR(COMPILE_ERR);
+        return false;
+    }
+
+    printf("%s compiled %u signatures into %s\n", MSG_PRE,
+           knownVirusesMatcher->patternCount, databaseToCompile);
+
+    return true;
+}
+
+/**
+ * @brief measure the scan throughput of the signatures file on the sample
+ * given with -bench, with every prefilter level, engine and layout.
+ *
+ * @return true if the benchmark ran.
+ */
+bool runBenchmark()
+{
+    loadViruses();
+
+    if (!knownVirusesMatcher)
+    {
+        PRINT_ERROR(NO_SIGNATURES_ERR);
+        return false;
+    }
+
+    if (!benchPrefilter(knownVirusesMatcher, benchSample, benchMegabytes) ||
+        !benchEngines(&knownViruses, benchSample, benchMegabytes) ||
+        !benchLayouts(&knownViruses, benchSample, benchMegabytes))
+    {
+        PRINT_ERROR(BENCH_ERR);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief measure loading the signatures file and scanning the file given
+ * with -benchscan.
+ *
+ * @return true if both were measured.
+ */
+bool runScanBenchmark()
+{
+    double start = benchClock(), elapsed;
+
+    loadViruses();
+
+    elapsed = benchClock() - start;
+
+    if (!knownVirusesMatcher)
+    {
+        PRINT_ERROR(NO_SIGNATURES_ERR);
+        return false;
+    }
+
+    printf("bench=load sigs=%s signatures=%u engine=%s layout=%s "
+           "matcher_bytes=%zu seconds=%.6f sigs_per_sec=%.0f "
+           "peak_rss_kb=%ld\n",
+           signaturesFilename, knownViruses.count,
+           engineName(knownVirusesMatcher->engine),
+           // only the automaton has a layout
+           knownVirusesMatcher->engine == ENGINE_AUTOMATON
+               ? acLayoutName(knownVirusesMatcher->layout)
+               : "none",
+           acMemory(knownVirusesMatcher), elapsed,
+           elapsed > 0 ? knownViruses.count / elapsed : 0.0, benchPeakRss());
+
+    if (!benchScanFile(knownVirusesMatcher, benchFile, pipelineDepth,
+                       chunkSize))
+    {
+        PRINT_ERROR(BENCH_ERR);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief load the signatures, and hand them over as a generation of their
+ * own instead of keeping them as the known viruses.
+ *
+ * @return sigGeneration* the generation, or NULL if no signatures were
+ * loaded.
+ */
+sigGeneration *loadGeneration()
+{
+    sigGeneration *generation = NULL;
+
+    loadViruses();
+
+    if (knownVirusesMatcher &&
+        (generation = generationCreate(&knownViruses, knownVirusesMatcher,
+                                       knownVirusesDatabase)))
+    {
+        printf("%s loaded %u signatures from %s\n", MSG_PRE,
+               knownViruses.count, signaturesFilename);
+        fflush(stdout);
+
+        // the generation owns them now
+        memset(&knownViruses, 0, sizeof(sigArena));
+        knownVirusesMatcher = NULL;
+        knownVirusesDatabase = NULL;
+    }
+    else
+    {
+        PRINT_ERROR(NO_SIGNATURES_ERR);
+    }
+
+    reset();
+
+    return generation;
+}
+
+/**
+ * @brief serve scan requests on the socket given with -daemon until
+ * interrupted.
+ *
+ * @return true if the daemon ran.
+ */
+bool runDaemon()
+{
+    daemonSummary summary;
+    sigGeneration *first;
+
+    if (!(first = loadGeneration()))
+    {
+        return false;
+    }
+
+    printf("%s listening on %s\n", MSG_PRE, daemonSocket);
+    fflush(stdout);
+
+    if (!daemonServe(daemonSocket, first, loadGeneration,
+                     threadCount > 0 ? threadCount : defaultThreadCount(),
+                     &summary))
+    {
+        PRINT_ERROR(DAEMON_ERR);
+        return false;
+    }
+
+    printf("%s served %llu requests on %llu connections: %llu infected, "
+           "%llu failed, %llu reloads (%llu failed)\n",
+           MSG_PRE, summary.requests, summary.connections, summary.infected,
+           summary.failed, summary.reloads + summary.failedReloads,
+           summary.failedReloads);
+
+    return true;
+}
+
+/**
+ * @brief count scanned files and the time they took, for -stats.
+ *
+ * @param files the number of files.
+ * @param start when their scan started, by statsClock.
+ */
+void countScan(unsigned long long files, double start)
+{
+    statsFiles += files;
+    statsWallSeconds += statsClock() - start;
+}
+
+/**
+ * @brief print the counters of every thread, their sum and the counters of
+ * every signature given with -stats, and stop counting.
+ */
+void printStats()
+{
+    const scanStats *thread;
+    scanStats total;
+    unsigned int i = 0;
+
+    if (!collectingStats || !statsMerge(&total))
+    {
+        return;
+    }
+
+    for (thread = statsList(); thread; thread = thread->next)
+    {
+        printf("stats=thread thread=%u bytes=%llu scan_seconds=%.6f "
+               "mb_per_sec=%.1f\n",
+               i++, thread->bytes, thread->scanSeconds,
+               thread->scanSeconds > 0
+                   ? thread->bytes / thread->scanSeconds / (1 << 20)
+                   : 0.0);
+    }
+
+    printf("stats=total signatures=%u threads=%u files=%llu bytes=%llu "
+           "load_seconds=%.6f scan_seconds=%.6f neutralize_seconds=%.6f "
+           "wall_seconds=%.6f files_per_sec=%.1f\n",
+           total.virusCount, i, statsFiles, total.bytes, total.loadSeconds,
+           total.scanSeconds, total.neutralizeSeconds, statsWallSeconds,
+           statsWallSeconds > 0 ? statsFiles / statsWallSeconds : 0.0);
+
+    for (i = 0; i < total.virusCount; i++)
+    {
+        printf("stats=signature index=%u hits=%llu attempts=%llu name=%s\n",
+               i, total.hits[i], total.attempts[i],
+               acVirus(knownVirusesMatcher, i)->virusName);
+    }
+
+    statsFree(&total);
+    statsStop();
+}
+
+/**
+ * @brief open the report given with -report, or stdout, for the results.
+ *
+ * @return true if the results can be written.
+ */
+bool openReport()
+{
+    FILE *out = stdout;
+
+    if (reportFilename && !(out = fopen(reportFilename, "w")))
+    {
+        PRINT_ERROR(REPORT_ERR);
+        return false;
+    }
+
+    if (!reportInit(&report, out, (reportFormat)reportFormatArgument))
+    {
+        PRINT_ERROR(MEMORY_ERR);
+        report.out = NULL;
+
+        if (reportFilename)
+        {
+            fclose(out);
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief write the rest of the results out and close the report.
+ */
+void closeReport()
+{
+    if (!report.out)
+    {
+        return;
+    }
+
+    if (!reportClose(&report) ||
+        (reportFilename && fclose(report.out) == EOF))
+    {
+        PRINT_ERROR(REPORT_WRITE_ERR);
+    }
+
+    report.out = NULL;
 }
@@ -0,0 +1,281 @@
+/**
+ * a work-stealing thread pool.
+ *
+ * every worker owns a deque. tasks submitted by a worker go to its own deque
+ * and are run newest first, so a task that splits itself keeps its parts
+ * close. an idle worker steals the oldest task of another worker, which
+ * tends to be the biggest piece of work left.
+ */
+
+#include <stdlib.h>
+#include "../include/workPool.h"
+
+#define INITIAL_TASKS 64
+
+/**
+ * @brief push a task at the tail of a deque.
+ *
+ * @param deque a deque.
+ * @param task the task to push.
+ * @return true on success, false if the deque couldn't grow.
+ */
+static bool pushTail(workDeque *deque, workTask task)
+{
+    workTask *tasks;
+    size_t i;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->count == deque->capacity)
+    {
+        // unroll the ring into a bigger array
+        tasks = (workTask *)malloc(2 * deque->capacity * sizeof(workTask));
+
+        if (!tasks)
+        {
+            pthread_mutex_unlock(&deque->lock);
+            return false;
+        }
+
+        for (i = 0; i < deque->count; i++)
+        {
+            tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        }
+
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->head = 0;
+        deque->capacity *= 2;
+    }
+
+    deque->tasks[(deque->head + deque->count) % deque->capacity] = task;
+    deque->count++;
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return true;
+}
+
+/**
+ * @brief take a task from a deque, the newest for its owner and the oldest
+ * for a thief.
+ *
+ * @param deque a deque.
+ * @param task receives the task.
+ * @param steal take from the head rather than from the tail?
+ * @return true if a task was taken.
+ */
+static bool takeTask(workDeque *deque, workTask *task, bool steal)
+{
+    bool taken = false;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->count > 0)
+    {
+        if (steal)
+        {
+            *task = deque->tasks[deque->head];
+            deque->head = (deque->head + 1) % deque->capacity;
+        }
+        else
+        {
+            *task = deque->tasks[(deque->head + deque->count - 1) %
+                                 deque->capacity];
+        }
+
+        deque->count--;
+        taken = true;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return taken;
+}
+
+/**
+ * @brief find a task for a worker: its own newest, or another's oldest.
+ *
+ * @param pool a pool.
+ * @param worker the worker's index.
+ * @param task receives the task.
+ * @return true if a task was found.
+ */
+static bool findTask(workPool *pool, int worker, workTask *task)
+{
+    int i;
+
+    if (takeTask(&pool->deques[worker], task, false))
+    {
+        return true;
+    }
+
+    // start from the next worker so thieves don't all hit the same victim
+    for (i = 1; i < pool->workerCount; i++)
+    {
+        if (takeTask(&pool->deques[(worker + i) % pool->workerCount], task,
+                     true))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief the loop of a worker thread.
+ *
+ * @param argument the worker's deque.
+ * @return void* unused.
+ */
+static void *workerMain(void *argument)
+{
+    workDeque *own = (workDeque *)argument;
+    workPool *pool = own->pool;
+    int worker = own - pool->deques;
+    workTask task;
+
+    while (true)
+    {
+        if (findTask(pool, worker, &task))
+        {
+            pthread_mutex_lock(&pool->lock);
+            pool->pending--;
+            pthread_mutex_unlock(&pool->lock);
+
+            task.run(task.argument, worker);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+
+        while (pool->pending == 0 && !pool->closing)
+        {
+            pthread_cond_wait(&pool->available, &pool->lock);
+        }
+
+        if (pool->pending == 0 && pool->closing)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+workPool *poolCreate(int workerCount)
+{
+    workPool *pool = (workPool *)calloc(1, sizeof(workPool));
+    int i;
+
+    if (!pool || workerCount < 1)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    pool->workerCount = workerCount;
+    pool->deques = (workDeque *)calloc(workerCount, sizeof(workDeque));
+    pool->threads = (pthread_t *)calloc(workerCount, sizeof(pthread_t));
+
+    if (!pool->deques || !pool->threads)
+    {
+        free(pool->deques);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+
+    for (i = 0; i < workerCount; i++)
+    {
+        pool->deques[i].pool = pool;
+        pool->deques[i].capacity = INITIAL_TASKS;
+        pool->deques[i].tasks = (workTask *)malloc(INITIAL_TASKS *
+                                                   sizeof(workTask));
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+
+    for (i = 0; i < workerCount; i++)
+    {
+        if (!pool->deques[i].tasks ||
+            pthread_create(&pool->threads[i], NULL, workerMain,
+                           &pool->deques[i]) != 0)
+        {
+            poolDestroy(pool);
+            return NULL;
+        }
+
+        pool->running++;
+    }
+
+    return pool;
+}
+
+bool poolSubmit(workPool *pool, taskFunction run, void *argument, int worker)
+{
+    workTask task = {run, argument};
+
+    if (worker == POOL_ANY_WORKER)
+    {
+        pthread_mutex_lock(&pool->lock);
+        worker = pool->nextDeque;
+        pool->nextDeque = (pool->nextDeque + 1) % pool->workerCount;
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    // counted before it is pushed, so the worker that takes it never
+    // brings pending below zero
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!pushTail(&pool->deques[worker], task))
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+        pthread_mutex_unlock(&pool->lock);
+
+        return false;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+
+    return true;
+}
+
+void poolDestroy(workPool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->closing = true;
+    pthread_cond_broadcast(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->running; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (i = 0; i < pool->workerCount; i++)
+    {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->available);
+
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}